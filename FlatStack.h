@@ -0,0 +1,109 @@
+#ifndef included_StackTrace_FlatStack
+#define included_StackTrace_FlatStack
+
+#include <cstdint>
+#include <vector>
+
+#include "StackTrace/StackTrace.h"
+
+
+namespace StackTrace {
+
+
+/*!
+ * @brief  Flat representation of a multi_stack_info
+ * @details  This class stores the same tree as multi_stack_info, but the nodes are
+ *    kept in a single contiguous array and refer to each other by index
+ *    (parent, first child, next sibling).  The frames are stored once in a
+ *    separate table and the nodes refer to them by id.  A node is always stored
+ *    after its parent and the root is node 0.  New children are linked at the
+ *    front of the list, so the siblings are in the reverse order they were added.
+ *    Children are found through a hash table of the (parent, frame) pairs, so
+ *    adding a stack of depth D costs O(D) regardless of the number of children and
+ *    the only allocations are the geometric growth of the arrays.
+ *    This is intended for aggregating large numbers of samples; use
+ *    toMultiStack() to convert the result for printing/communication.
+ */
+class flat_stack_info final
+{
+public:
+    //! Index used to indicate no node/frame
+    static constexpr uint32_t npos = 0xFFFFFFFF;
+
+    //! Node in the tree
+    struct node {
+        int64_t N;            //!< Number of threads/processes (or weight)
+        uint32_t frame;       //!< Id of the frame (npos for the root)
+        uint32_t parent;      //!< Index of the parent (npos for the root)
+        uint32_t firstChild;  //!< Index of the first child (npos if there are no children)
+        uint32_t nextSibling; //!< Index of the next sibling (npos if there are no more)
+    };
+
+public:
+    //! Empty constructor
+    flat_stack_info();
+
+    //! Construct from a multi_stack_info
+    explicit flat_stack_info( const multi_stack_info &stack );
+
+    //! Reset the tree
+    void clear();
+
+    //! Reserve space for the given number of nodes and frames
+    void reserve( size_t nodes, size_t frames );
+
+    //! Number of nodes (including the root)
+    size_t size() const { return d_nodes.size(); }
+
+    //! Number of unique frames
+    size_t numberOfFrames() const { return d_frames.size(); }
+
+    //! Get a node
+    const node &operator[]( uint32_t i ) const { return d_nodes[i]; }
+
+    //! Get a frame
+    const stack_info &frame( uint32_t id ) const { return d_frames[id]; }
+
+    //! Count for the root
+    int64_t N() const { return d_nodes[0].N; }
+
+    //! Get the id for a frame (adding it if it does not exist)
+    uint32_t addFrame( const stack_info &stack );
+
+    //! Get the child of a node for the given frame (adding it with N=0 if it does not exist)
+    uint32_t getChild( uint32_t parent, uint32_t frame );
+
+    //! Add to the count of a node
+    void addCount( uint32_t index, int64_t count ) { d_nodes[index].N += count; }
+
+    //! Add the given stack (stack[0] is the leaf, count is the number of times it occurs)
+    void add( size_t len, const stack_info *stack, int64_t count = 1 );
+
+    //! Add the given stack of frame ids (frames[0] is the leaf)
+    void add( size_t len, const uint32_t *frames, int64_t count = 1 );
+
+    //! Add a multi_stack_info
+    void add( const multi_stack_info &stack );
+
+    //! Add another flat tree
+    void add( const flat_stack_info &stack );
+
+    //! Convert to a multi_stack_info
+    multi_stack_info toMultiStack() const;
+
+private:
+    void rehashFrames( size_t size );
+    void rehashChildren( size_t size );
+    void insertFrame( uint32_t id );
+    void insertChild( uint32_t index );
+
+    std::vector<node> d_nodes;
+    std::vector<stack_info> d_frames;
+    std::vector<uint32_t> d_frameTable; // Open-addressing hash table of the frames
+    std::vector<uint32_t> d_childTable; // Open-addressing hash table of the (parent, frame) pairs
+};
+
+
+} // namespace StackTrace
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef included_StackTrace_Internal
+#define included_StackTrace_Internal
+
+#include "StackTrace/StackTrace.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+
+
+// Functions shared by the StackTrace sources (not part of the public interface)
+namespace StackTrace::Internal {
+
+
+/*!
+ * @brief  Get the call stack from a signal handler
+ * @details  This function gets the call stack of the current thread and removes the
+ *    frames of the signal handler (the stack starts at the interrupted instruction).
+ *    Note: This function is only availible on Linux and macOS.
+ * @param[out] buffer   Addresses in the call stack
+ * @param[in] size      Size of the buffer
+ * @param[in] context   Context passed to the signal handler (SA_SIGINFO)
+ * @return              Returns the number of frames
+ */
+int backtrace_signal( void **buffer, int size, void *context );
+
+
+//! Hash of an address
+inline size_t hashAddress( const void *address )
+{
+    uint64_t x = reinterpret_cast<uintptr_t>( address ) * 0x9E3779B97F4A7C15ull;
+    return x ^ ( x >> 32 );
+}
+
+
+//! Hash of the object and offset of a frame (the second key used by stack_info::operator==)
+inline size_t hashObject( const stack_info &stack )
+{
+    return hashAddress( stack.address2 ) ^ std::hash<std::string_view>()( stack.object.data() );
+}
+
+
+//! Check if the stack contains a frame (the root of a merged stack does not)
+inline bool hasFrame( const stack_info &stack )
+{
+    return stack.address != nullptr || stack.function[0] != 0 || stack.object[0] != 0;
+}
+
+
+//! Get the name of a frame (the function, or the object and offset if it is unknown)
+inline const char *getName( const stack_info &stack, char *buf, size_t size )
+{
+    if ( stack.function[0] != 0 )
+        return stack.function.data();
+    if ( stack.object[0] != 0 )
+        snprintf( buf, size, "%s+0x%zx", stack.object.data(), (size_t) stack.address2 );
+    else
+        snprintf( buf, size, "0x%zx", (size_t) stack.address );
+    return buf;
+}
+
+
+//! Width of the object column when printing a stack
+constexpr int printWidthObject = 20;
+
+//! Width of the function column when printing a stack
+constexpr int printWidthFunction = 40;
+
+
+//! Get the width of the address column for a tree (multi_stack_info or multi_stack_diff)
+template<class TYPE>
+int getAddressWidth( const TYPE &stack )
+{
+    int w = stack.stack.getAddressWidth();
+    for ( const auto &child : stack.children )
+        w = std::max( w, getAddressWidth( child ) );
+    return w;
+}
+
+
+/*!
+ * @brief  Print a tree
+ * @details  This function prints a tree (multi_stack_info or multi_stack_diff) with one
+ *    line for each frame, calling fun(line) for each line.
+ * @param[in] stack     Tree to print
+ * @param[in,out] prefix  Prefix for the lines (restored on return)
+ * @param[in] w         Width of the address column
+ * @param[in] c         Continue the branch of the parent ("| ")
+ * @param[in,out] line  Buffer for the line
+ * @param[in] count     Function to format the count: count(stack, buf, size)
+ * @param[in] fun       Function to call for each line
+ */
+template<class TYPE, class COUNT, class FUN>
+void printTree( const TYPE &stack, std::string &prefix, int w, bool c, std::string &line,
+                const COUNT &count, FUN &fun )
+{
+    size_t length = prefix.size();
+    if ( stack.stack.address != 0 ) {
+        char buf[128], frame[32 + sizeof( stack_info )];
+        count( stack, buf, sizeof( buf ) );
+        stack.stack.print2( frame, w, printWidthObject, printWidthFunction );
+        line = prefix;
+        line += buf;
+        line += frame;
+        fun( line );
+        prefix += c ? "| " : "  ";
+    }
+    for ( size_t i = 0; i < stack.children.size(); i++ ) {
+        bool c2 = i + 1 < stack.children.size() && stack.stack.address != 0;
+        printTree( stack.children[i], prefix, w, c2, line, count, fun );
+    }
+    prefix.resize( length );
+}
+
+
+//! Get the self count of a node (the count that is not in the children)
+inline int64_t getSelf( const multi_stack_info &stack )
+{
+    int64_t N = stack.N;
+    for ( const auto &child : stack.children )
+        N -= child.N;
+    return std::max<int64_t>( N, 0 );
+}
+
+
+} // namespace StackTrace::Internal
+
+#endif
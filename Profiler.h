@@ -0,0 +1,223 @@
+#ifndef included_StackTrace_Profiler
+#define included_StackTrace_Profiler
+
+#include "StackTrace/StackTrace.h"
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace StackTrace::Profiler {
+
+
+//! Clock used to trigger the samples
+enum class sampleClock : uint8_t {
+    wall, //!< Sample at a fixed rate in real time (includes time the thread is blocked)
+    cpu   //!< Sample at a fixed rate in the CPU time consumed by each thread
+};
+
+
+/*!
+ * @brief  Start the sampling profiler
+ * @details  This function starts a statistical profiler for the registered threads.
+ *    Each thread is periodically interrupted by a timer signal and the raw call stack
+ *    is stored in a lock-free buffer for the thread.  The call stacks are only
+ *    decoded when the profiler is stopped, so the profiler may be left enabled.
+ *    Threads that are registered while the profiler is running are added.
+ *    With sampleClock::cpu each thread uses a timer on its own CPU-time clock,
+ *    so idle threads are not sampled and the counts are proportional to the
+ *    CPU time consumed.
+ *    Note: This functionality is currently only availible on Linux
+ * @param[in] hz        The number of samples per second for each thread
+ * @param[in] clock     The clock used to trigger the samples
+ */
+void start( int hz = 100, sampleClock clock = sampleClock::wall );
+
+
+/*!
+ * @brief  Stop the sampling profiler
+ * @details  This function stops the profiler and returns the aggregated call stacks
+ *    for all samples.  The count for each entry (N) is the number of samples.
+ * @return              Returns the profile
+ */
+multi_stack_info stop();
+
+
+//! Check if the profiler is running
+bool running();
+
+
+//! Return the number of samples that were lost because the buffers were full
+size_t droppedSamples();
+
+
+/*!
+ * @brief  Get the samples collected so far
+ * @details  This function returns the aggregated call stacks for the samples collected
+ *    since the profiler was started (or the last call to flush) and clears them.
+ *    Unlike stop(), the profiler keeps running.
+ * @return              Returns the profile
+ */
+multi_stack_info flush();
+
+
+//! Wall-clock profile separating the time threads are running and blocked
+struct wallClockProfile {
+    multi_stack_info running; //!< Samples where the thread was running
+    multi_stack_info blocked; //!< Samples where the thread was blocked (leaf is the blocking call)
+};
+
+
+/*!
+ * @brief  Start the wall-clock profiler
+ * @details  This function starts a profiler that periodically captures the call stack
+ *    of all registered threads, whether they are running or not.  Before capturing
+ *    the stacks, the state of each thread and the system call it is blocked in are
+ *    read from /proc.  Blocked samples are tagged with the blocking call (e.g. [futex],
+ *    [read], [ppoll]), and running threads inside MPI are tagged as [MPI progress]
+ *    since they are usually polling for messages.  This is more expensive than the
+ *    sampling profiler and is intended for lower sampling rates.
+ *    Note: This functionality is currently only availible on Linux
+ * @param[in] hz        The number of samples per second
+ */
+void startWallClock( int hz = 10 );
+
+
+/*!
+ * @brief  Stop the wall-clock profiler
+ * @details  This function stops the wall-clock profiler and returns the aggregated
+ *    call stacks for the running and blocked samples.
+ * @return              Returns the profile
+ */
+wallClockProfile stopWallClock();
+
+
+//! Check if the wall-clock profiler is running
+bool wallClockIsRunning();
+
+
+/*!
+ * @brief  Start the heap profiler
+ * @details  This function starts sampling the memory allocations (malloc, calloc,
+ *    realloc, the aligned allocation functions and operator new).  On average one
+ *    allocation is sampled for every sampleBytes bytes allocated (Poisson sampling),
+ *    and the call stack of each sampled allocation is kept until it is freed.
+ *    When the profiler is not running the overhead is a single atomic load per call.
+ *    Note: This functionality is currently only availible on Linux with glibc, and
+ *    only if the library was configured with USE_HEAP_PROFILER (the allocation
+ *    functions are only replaced when it is enabled)
+ * @param[in] sampleBytes   The average number of bytes between samples
+ */
+void startHeap( size_t sampleBytes = 512 * 1024 );
+
+
+//! Stop sampling new allocations (sampled allocations are still tracked until freed)
+void stopHeap();
+
+
+/*!
+ * @brief  Get the heap profile
+ * @details  This function returns the call stacks of the live sampled allocations.
+ *    The count for each entry (N) is the estimated number of bytes allocated.
+ * @return              Returns the profile
+ */
+multi_stack_info getHeapProfile();
+
+
+//! Return the number of samples that were lost because the table of live allocations was full
+size_t heapDroppedSamples();
+
+
+/*!
+ * @brief  Start recording the profile to disk
+ * @details  This function starts a background thread that flushes the sampling
+ *    profiler every interval seconds and appends the aggregated call stacks to
+ *    segment files (<prefix>.<n>.prof) in a compact binary format.  When a segment
+ *    exceeds maxSegmentBytes a new segment is started, and the oldest segments are
+ *    removed so that at most maxSegments are kept on disk.  The profiler is started
+ *    with the default options if it is not already running.
+ * @param[in] prefix            Prefix for the segment files
+ * @param[in] interval          Time between flushes (seconds)
+ * @param[in] maxSegmentBytes   Maximum size of a segment (bytes)
+ * @param[in] maxSegments       Maximum number of segments to keep
+ */
+void startRecording( const std::string &prefix, double interval = 10,
+                     size_t maxSegmentBytes = 16 * 1024 * 1024, int maxSegments = 16 );
+
+
+//! Stop recording (the profiler is stopped if it was started by startRecording)
+void stopRecording();
+
+
+/*!
+ * @brief  Read a recorded profile
+ * @details  This function reads the segment files written by startRecording and
+ *    merges the flushes that overlap the given time window.  The records are
+ *    merged one at a time so the memory is bounded by the size of the result.
+ * @param[in] prefix            Prefix for the segment files
+ * @param[in] startTime         Start of the time window (seconds since the epoch)
+ * @param[in] endTime           End of the time window (seconds since the epoch)
+ * @return                      Returns the profile
+ */
+multi_stack_info readRecording( const std::string &prefix, double startTime = 0,
+                                double endTime = std::numeric_limits<double>::max() );
+
+
+} // namespace StackTrace::Profiler
+
+
+namespace StackTrace {
+
+
+/*!
+ * @brief  Mutex that records where it is contended
+ * @details  This class is a drop-in replacement for std::mutex.  The fast path is a
+ *    try_lock.  If the mutex is already locked, the time spent waiting and the call
+ *    stack are recorded in a global table (shared by all profiled mutexes).  The call
+ *    stack is captured before waiting and recorded after the mutex is unlocked, so the
+ *    profiler does not add to the critical section it is measuring.
+ *    report() returns the call stacks weighted by the total wait time (ns).
+ */
+class profiled_mutex final
+{
+public:
+    profiled_mutex()                                   = default;
+    profiled_mutex( const profiled_mutex & )            = delete;
+    profiled_mutex &operator=( const profiled_mutex & ) = delete;
+    //! Lock the mutex
+    inline void lock()
+    {
+        if ( !d_mutex.try_lock() )
+            lockContended();
+    }
+    //! Unlock the mutex
+    inline void unlock()
+    {
+        if ( d_pending )
+            unlockContended();
+        else
+            d_mutex.unlock();
+    }
+    //! Try to lock the mutex
+    inline bool try_lock() { return d_mutex.try_lock(); }
+    //! Get the contention profile for all profiled mutexes (N is the wait time in ns)
+    static multi_stack_info report();
+    //! Clear the recorded contention
+    static void reset();
+
+private:
+    void lockContended();
+    void unlockContended();
+    std::mutex d_mutex;
+    bool d_pending = false;      // The wait for the current lock has not been recorded
+    int64_t d_wait = 0;          // Time waiting for the current lock (ns)
+    std::vector<void *> d_trace; // Call stack for the current lock
+};
+
+
+} // namespace StackTrace
+
+#endif
@@ -1,5 +1,6 @@
 #include "StackTrace/StackTrace.h"
 #include "StackTrace/ErrorHandlers.h"
+#include "StackTrace/Internal.h"
 #include "StackTrace/StaticVector.h"
 #include "StackTrace/Utilities.h"
 #include "StackTrace/Utilities.hpp"
@@ -8,8 +9,10 @@
 #include <algorithm>
 #include <atomic>
 #include <cerrno>
+#include <charconv>
 #include <csignal>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -19,6 +22,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <thread>
+#include <tuple>
 
 
 #define perr std::cerr
@@ -49,6 +53,7 @@
     #include <DbgHelp.h>
     #include <TlHelp32.h>
     #include <Psapi.h>
+    #include <io.h>
     #include <process.h>
     #include <stdio.h>
     #include <tchar.h>
@@ -61,6 +66,19 @@
     #include <ctime>
     #include <unistd.h>
     #include <sys/syscall.h>
+    #include <ucontext.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+#ifdef USE_LINUX
+    #include <dirent.h>
+    #include <elf.h>
+    #include <sys/ptrace.h>
+    #include <sys/uio.h>
+    #include <sys/user.h>
+    #include <sys/wait.h>
 #endif
 #ifdef USE_MAC
     #include <mach-o/dyld.h>
@@ -401,110 +419,219 @@ void StackTrace::multi_stack_info::clear()
     N = 0;
     stack.clear();
     children.clear();
+    invalidateIndex();
 }
 template<class FUN>
-void StackTrace::multi_stack_info::print2( int Np, char *prefix, int w[3], bool c, FUN &fun ) const
+void StackTrace::multi_stack_info::print2( const std::string &prefix, FUN &fun ) const
 {
-    if ( stack.address != 0 ) {
-        prefix[Np] = 0;
-        char line[4096];
-        int N2 = sprintf( line, "%s[%i] ", prefix, N );
-        stack.print2( &line[N2], w[0], w[1], w[2] );
-        fun( line );
-        prefix[Np++] = c ? '|' : ' ';
-        prefix[Np++] = ' ';
-    }
-    for ( size_t i = 0; i < children.size(); i++ ) {
-        bool c2           = children.size() > 1 && i < children.size() - 1 && stack.address != 0;
-        const auto &child = children[i];
-        child.print2( Np, prefix, w, c2, fun );
-    }
+    auto count = []( const multi_stack_info &stack, char *buf, size_t size ) {
+        snprintf( buf, size, "[%lli] ", static_cast<long long>( stack.N ) );
+    };
+    std::string prefix2( prefix ), line;
+    prefix2.reserve( prefix.size() + 256 );
+    line.reserve( 512 );
+    Internal::printTree( *this, prefix2, Internal::getAddressWidth( *this ), false, line, count,
+                         fun );
 }
 std::vector<std::string> StackTrace::multi_stack_info::print( const std::string &prefix ) const
 {
     std::vector<std::string> text;
-    int w[3] = { getAddressWidth(), getObjectWidth(), getFunctionWidth() };
-    char prefix2[1024];
-    memcpy( prefix2, prefix.data(), prefix.size() );
-    auto fun = [&text]( const char *line ) { text.push_back( line ); };
-    print2( prefix.size(), prefix2, w, false, fun );
+    auto fun = [&text]( const std::string &line ) { text.push_back( line ); };
+    print2( prefix, fun );
     return text;
 }
 void StackTrace::multi_stack_info::print( std::ostream &out, const std::string &prefix ) const
 {
-    int w[3] = { getAddressWidth(), getObjectWidth(), getFunctionWidth() };
-    char prefix2[1024];
-    memcpy( prefix2, prefix.data(), prefix.size() );
-    auto fun = [&out]( const char *line ) { out << line << std::endl; };
-    print2( prefix.size(), prefix2, w, false, fun );
+    // Write the output in blocks
+    std::string buffer;
+    buffer.reserve( 0x10000 );
+    auto fun = [&out, &buffer]( const std::string &line ) {
+        buffer += line;
+        buffer += '\n';
+        if ( buffer.size() >= 0xF000 ) {
+            out.write( buffer.data(), buffer.size() );
+            buffer.clear();
+        }
+    };
+    print2( prefix, fun );
+    out.write( buffer.data(), buffer.size() );
+    out.flush();
 }
-std::string StackTrace::multi_stack_info::printString( const std::string &prefix ) const
+static void writeFD( int fd, const char *data, size_t N )
 {
-    int w[3] = { getAddressWidth(), getObjectWidth(), getFunctionWidth() };
-    char prefix2[1024];
-    memcpy( prefix2, prefix.data(), prefix.size() );
-    std::string out;
-    out.reserve( 4096 );
-    auto fun = [&out]( const char *line ) {
+    while ( N > 0 ) {
+#ifdef USE_WINDOWS
+        int N2 = _write( fd, data, static_cast<unsigned int>( N ) );
+#else
+        auto N2 = ::write( fd, data, N );
+#endif
+        if ( N2 < 0 && errno == EINTR )
+            continue;
+        if ( N2 <= 0 )
+            return;
+        data += N2;
+        N -= N2;
+    }
+}
+void StackTrace::multi_stack_info::print( int fd, const std::string &prefix ) const
+{
+    // Write the output in blocks
+    std::string buffer;
+    buffer.reserve( 0x10000 );
+    auto fun = [fd, &buffer]( const std::string &line ) {
+        buffer += line;
+        buffer += '\n';
+        if ( buffer.size() >= 0xF000 ) {
+            writeFD( fd, buffer.data(), buffer.size() );
+            buffer.clear();
+        }
+    };
+    print2( prefix, fun );
+    writeFD( fd, buffer.data(), buffer.size() );
+}
+void StackTrace::multi_stack_info::appendString( std::string &out, const std::string &prefix ) const
+{
+    auto fun = [&out]( const std::string &line ) {
         out += line;
         out += '\n';
     };
-    print2( prefix.size(), prefix2, w, false, fun );
-    return out;
+    print2( prefix, fun );
 }
-int StackTrace::multi_stack_info::getAddressWidth() const
+std::string StackTrace::multi_stack_info::printString( const std::string &prefix ) const
 {
-    int w = stack.getAddressWidth();
-    for ( const auto &child : children )
-        w = std::max( w, child.getAddressWidth() );
-    return w;
+    std::string out;
+    out.reserve( 4096 );
+    appendString( out, prefix );
+    return out;
 }
-int StackTrace::multi_stack_info::getObjectWidth() const
-{
-    int w = std::min<int>( stack.object.size() + 1, 20 );
-    for ( const auto &child : children )
-        w = std::max( w, child.getObjectWidth() );
-    return w;
+static constexpr size_t minIndexedChildren = 8;
+using StackTrace::Internal::hashAddress;
+using StackTrace::Internal::hashObject;
+// Hash of the keys used by stack_info::operator== (0: address, 1: object+offset)
+static inline uint32_t getKeyHash( const StackTrace::stack_info &s, int key )
+{
+    return static_cast<uint32_t>( key == 0 ? hashAddress( s.address ) : hashObject( s ) );
+}
+void StackTrace::multi_stack_info::buildIndex()
+{
+    // Keep the load factor below 1/2
+    size_t Nc   = children.size();
+    size_t size = 4 * minIndexedChildren;
+    while ( size < 8 * Nc )
+        size *= 2;
+    d_index.table.assign( size, childIndex::slot{ 0, 0 } );
+    d_index.data  = children.data();
+    d_index.count = Nc;
+    for ( size_t i = 0; i < Nc; i++ )
+        indexChild( i );
+}
+void StackTrace::multi_stack_info::indexChild( size_t i )
+{
+    // Each child is inserted for both keys used by stack_info::operator==
+    size_t mask = d_index.table.size() - 1;
+    for ( int key = 0; key < 2; key++ ) {
+        uint32_t hash = getKeyHash( children[i].stack, key );
+        size_t k      = hash & mask;
+        while ( d_index.table[k].child != 0 )
+            k = ( k + 1 ) & mask;
+        d_index.table[k] = { static_cast<uint32_t>( i + 1 ), hash };
+    }
+}
+size_t StackTrace::multi_stack_info::findChild( const stack_info &s )
+{
+    size_t Nc = children.size();
+    if ( Nc < minIndexedChildren ) {
+        for ( size_t i = 0; i < Nc; i++ ) {
+            if ( children[i].stack == s )
+                return i;
+        }
+        return Nc;
+    }
+    // Rebuild the index if the children were reallocated or resized
+    if ( d_index.data != children.data() || d_index.count != Nc ||
+         4 * Nc > d_index.table.size() )
+        buildIndex();
+    // Find the first child that matches either key
+    // Note: an entry whose child no longer has its hash means the children were changed
+    //   in place (e.g. reordered), the index is rebuilt and the search is repeated
+    size_t index = Nc;
+    size_t mask  = d_index.table.size() - 1;
+    for ( int key = 0; key < 2; key++ ) {
+        uint32_t hash = getKeyHash( s, key );
+        for ( size_t k = hash & mask; d_index.table[k].child != 0; k = ( k + 1 ) & mask ) {
+            if ( d_index.table[k].hash != hash )
+                continue;
+            size_t i = d_index.table[k].child - 1;
+            if ( getKeyHash( children[i].stack, key ) != hash ) {
+                buildIndex();
+                return findChild( s );
+            }
+            if ( i < index && children[i].stack == s )
+                index = i;
+        }
+    }
+    return index;
 }
-int StackTrace::multi_stack_info::getFunctionWidth() const
+size_t StackTrace::multi_stack_info::getChild( const stack_info &s )
 {
-    int w = std::min<int>( stack.function.size() + 1, 40 );
-    for ( const auto &child : children )
-        w = std::max( w, child.getFunctionWidth() );
-    return w;
+    size_t i = findChild( s );
+    if ( i == children.size() ) {
+        children.resize( children.size() + 1 );
+        children.back().N     = 0;
+        children.back().stack = s;
+        if ( d_index.data == children.data() && d_index.count + 1 == children.size() &&
+             4 * children.size() <= d_index.table.size() ) {
+            d_index.count++;
+            indexChild( i );
+        }
+    }
+    return i;
 }
-void StackTrace::multi_stack_info::add( size_t len, const stack_info *stack )
+void StackTrace::multi_stack_info::add( size_t len, const stack_info *stack, int64_t count )
 {
     if ( len == 0 )
         return;
-    const auto &s = stack[len - 1];
-    for ( auto &i : children ) {
-        if ( i.stack == s ) {
-            i.N++;
-            if ( len > 1 )
-                i.add( len - 1, stack );
-            return;
-        }
-    }
-    children.resize( children.size() + 1 );
-    children.back().N     = 1;
-    children.back().stack = s;
+    size_t i = getChild( stack[len - 1] );
+    children[i].N += count;
     if ( len > 1 )
-        children.back().add( len - 1, stack );
+        children[i].add( len - 1, stack, count );
 }
 void StackTrace::multi_stack_info::add( const multi_stack_info &rhs )
 {
     N += rhs.N;
     for ( const auto &x : rhs.children ) {
-        bool found = false;
-        for ( auto &tmp : children ) {
-            if ( tmp.stack == x.stack ) {
-                found = true;
-                tmp.add( x );
+        size_t i = findChild( x.stack );
+        if ( i < children.size() ) {
+            children[i].add( x );
+        } else {
+            children.push_back( x );
+            if ( d_index.data == children.data() && d_index.count + 1 == children.size() &&
+                 4 * children.size() <= d_index.table.size() ) {
+                d_index.count++;
+                indexChild( i );
             }
         }
-        if ( !found )
-            children.push_back( x );
+    }
+}
+void StackTrace::multi_stack_info::add( multi_stack_info &&rhs )
+{
+    N += rhs.N;
+    for ( auto &x : rhs.children )
+        addChild( std::move( x ) );
+    rhs.clear();
+}
+void StackTrace::multi_stack_info::addChild( multi_stack_info &&child )
+{
+    size_t i = findChild( child.stack );
+    if ( i < children.size() ) {
+        children[i].add( std::move( child ) );
+    } else {
+        children.push_back( std::move( child ) );
+        if ( d_index.data == children.data() && d_index.count + 1 == children.size() &&
+             4 * children.size() <= d_index.table.size() ) {
+            d_index.count++;
+            indexChild( i );
+        }
     }
 }
 size_t StackTrace::multi_stack_info::size() const
@@ -516,7 +643,9 @@ size_t StackTrace::multi_stack_info::size() const
 }
 char *StackTrace::multi_stack_info::pack( char *ptr ) const
 {
-    int N2 = N;
+    if ( N < 0 || N > std::numeric_limits<int>::max() )
+        throw std::logic_error( "Stack count does not fit in the legacy format (use packCompact)" );
+    int N2 = static_cast<int>( N );
     memcpy( ptr, &N2, sizeof( int ) );
     ptr += sizeof( int );
     ptr    = stack.pack( ptr );
@@ -527,6 +656,406 @@ char *StackTrace::multi_stack_info::pack( char *ptr ) const
         ptr = tmp.pack( ptr );
     return ptr;
 }
+/****************************************************************************
+ *  Compact format for multi_stack_info                                      *
+ *  Header: magic (4 bytes), version (1 byte), reserved (1 byte), payload    *
+ *    length (4 bytes, little endian), checksum of payload (4 bytes, LE)     *
+ *  Payload: the string table, the frames (sorted by address with the        *
+ *    addresses delta encoded) and the tree (pre-order).  All integers in    *
+ *    the payload are varints so the format does not depend on endianness.   *
+ ****************************************************************************/
+static constexpr char compactMagic[4]  = { '\x7f', 'S', 'T', 'K' };
+static constexpr uint8_t compactVersion = 2;
+static constexpr size_t compactHeader   = 14;
+static uint32_t compactChecksum( const char *data, size_t N )
+{
+    uint32_t hash = 0x811c9dc5;
+    for ( size_t i = 0; i < N; i++ )
+        hash = ( hash ^ static_cast<uint8_t>( data[i] ) ) * 0x01000193;
+    return hash;
+}
+static void writeUInt32( char *ptr, uint32_t x )
+{
+    for ( int i = 0; i < 4; i++ )
+        ptr[i] = static_cast<char>( ( x >> ( 8 * i ) ) & 0xFF );
+}
+static uint32_t readUInt32( const char *ptr )
+{
+    uint32_t x = 0;
+    for ( int i = 0; i < 4; i++ )
+        x |= static_cast<uint32_t>( static_cast<uint8_t>( ptr[i] ) ) << ( 8 * i );
+    return x;
+}
+static void writeVarint( std::vector<char> &out, uint64_t x )
+{
+    while ( x >= 0x80 ) {
+        out.push_back( static_cast<char>( ( x & 0x7F ) | 0x80 ) );
+        x >>= 7;
+    }
+    out.push_back( static_cast<char>( x ) );
+}
+static void writeSigned( std::vector<char> &out, int64_t x )
+{
+    writeVarint( out, ( static_cast<uint64_t>( x ) << 1 ) ^ static_cast<uint64_t>( x >> 63 ) );
+}
+static uint64_t readVarint( const char *&ptr, const char *end )
+{
+    uint64_t x = 0;
+    for ( int shift = 0; ptr < end && shift < 64; shift += 7 ) {
+        auto byte = static_cast<uint8_t>( *ptr++ );
+        x |= static_cast<uint64_t>( byte & 0x7F ) << shift;
+        if ( ( byte & 0x80 ) == 0 )
+            return x;
+    }
+    throw std::logic_error( "Corrupt stack data" );
+}
+static int64_t readSigned( const char *&ptr, const char *end )
+{
+    uint64_t x = readVarint( ptr, end );
+    return static_cast<int64_t>( x >> 1 ) ^ -static_cast<int64_t>( x & 1 );
+}
+static bool isCompact( const char *ptr )
+{
+    return memcmp( ptr, compactMagic, sizeof( compactMagic ) ) == 0;
+}
+namespace {
+class compactEncoder final
+{
+public:
+    explicit compactEncoder( const StackTrace::multi_stack_info &stack )
+    {
+        // Get the unique frames sorted by address
+        addFrames( stack );
+        std::vector<const StackTrace::stack_info *> frames;
+        frames.reserve( d_frameIndex.size() );
+        for ( const auto &tmp : d_frameIndex )
+            frames.push_back( tmp.second.second );
+        std::sort( frames.begin(), frames.end(), []( auto a, auto b ) {
+            return std::make_pair( a->address, a->address2 ) <
+                   std::make_pair( b->address, b->address2 );
+        } );
+        for ( size_t i = 0; i < frames.size(); i++ )
+            d_frameIndex[getKey( *frames[i] )].first = i;
+        // Encode the frames and the tree
+        intptr_t address = 0, address2 = 0;
+        for ( auto frame : frames ) {
+            auto ptr  = reinterpret_cast<intptr_t>( frame->address );
+            auto ptr2 = reinterpret_cast<intptr_t>( frame->address2 );
+            writeSigned( d_frames, ptr - address );
+            writeSigned( d_frames, ptr2 - address2 );
+            writeVarint( d_frames, frame->line );
+            writeVarint( d_frames, getString( frame->object.data() ) );
+            writeVarint( d_frames, getString( frame->objectPath.data() ) );
+            writeVarint( d_frames, getString( frame->filename.data() ) );
+            writeVarint( d_frames, getString( frame->filenamePath.data() ) );
+            writeVarint( d_frames, getString( frame->function.data() ) );
+            address  = ptr;
+            address2 = ptr2;
+        }
+        d_Nframes = frames.size();
+        writeTree( stack );
+    }
+    std::vector<char> pack() const
+    {
+        std::vector<char> payload;
+        size_t bytes = d_frames.size() + d_tree.size() + 16;
+        for ( const auto &str : d_strings )
+            bytes += str.size() + 2;
+        payload.reserve( bytes );
+        writeVarint( payload, d_strings.size() );
+        for ( const auto &str : d_strings ) {
+            writeVarint( payload, str.size() );
+            payload.insert( payload.end(), str.begin(), str.end() );
+        }
+        writeVarint( payload, d_Nframes );
+        payload.insert( payload.end(), d_frames.begin(), d_frames.end() );
+        payload.insert( payload.end(), d_tree.begin(), d_tree.end() );
+        std::vector<char> data( compactHeader + payload.size() );
+        memcpy( data.data(), compactMagic, sizeof( compactMagic ) );
+        data[4] = static_cast<char>( compactVersion );
+        data[5] = 0;
+        writeUInt32( &data[6], payload.size() );
+        writeUInt32( &data[10], compactChecksum( payload.data(), payload.size() ) );
+        memcpy( &data[compactHeader], payload.data(), payload.size() );
+        return data;
+    }
+
+private:
+    using frameKey = std::tuple<void *, void *, uint32_t, string_view, string_view, string_view,
+                                string_view, string_view>;
+    static frameKey getKey( const StackTrace::stack_info &s )
+    {
+        return frameKey( s.address, s.address2, s.line, s.object.data(), s.objectPath.data(),
+                         s.filename.data(), s.filenamePath.data(), s.function.data() );
+    }
+    void addFrames( const StackTrace::multi_stack_info &stack )
+    {
+        if ( stack.stack.address != nullptr )
+            d_frameIndex.emplace( getKey( stack.stack ), std::make_pair( 0, &stack.stack ) );
+        for ( const auto &child : stack.children )
+            addFrames( child );
+    }
+    void writeTree( const StackTrace::multi_stack_info &stack )
+    {
+        // Frame 0 is reserved for nodes without a frame (e.g. the root)
+        size_t id = 0;
+        if ( stack.stack.address != nullptr )
+            id = d_frameIndex[getKey( stack.stack )].first + 1;
+        writeVarint( d_tree, id );
+        writeSigned( d_tree, stack.N );
+        writeVarint( d_tree, stack.children.size() );
+        for ( const auto &child : stack.children )
+            writeTree( child );
+    }
+    size_t getString( string_view str )
+    {
+        auto it = d_stringIndex.find( str );
+        if ( it != d_stringIndex.end() )
+            return it->second;
+        d_strings.push_back( str );
+        d_stringIndex.emplace( str, d_strings.size() - 1 );
+        return d_strings.size() - 1;
+    }
+    std::map<frameKey, std::pair<size_t, const StackTrace::stack_info *>> d_frameIndex;
+    std::map<string_view, size_t> d_stringIndex;
+    std::vector<string_view> d_strings;
+    std::vector<char> d_frames;
+    std::vector<char> d_tree;
+    size_t d_Nframes = 0;
+};
+} // namespace
+std::vector<char> StackTrace::multi_stack_info::packCompact() const
+{
+    return compactEncoder( *this ).pack();
+}
+
+
+/****************************************************************************
+ *  Read-only view of the compact format                                     *
+ ****************************************************************************/
+using StackTrace::packed_stack_view;
+static void copyString( string_view src, char *dst, size_t N )
+{
+    size_t len = std::min( src.size(), N - 1 );
+    memcpy( dst, src.data(), len );
+    memset( dst + len, 0, N - len );
+}
+StackTrace::stack_info packed_stack_view::frame::toStackInfo() const
+{
+    stack_info stack;
+    stack.address  = address;
+    stack.address2 = address2;
+    stack.line     = line;
+    copyString( object, stack.object.data(), stack.object.size() );
+    copyString( objectPath, stack.objectPath.data(), stack.objectPath.size() );
+    copyString( filename, stack.filename.data(), stack.filename.size() );
+    copyString( filenamePath, stack.filenamePath.data(), stack.filenamePath.size() );
+    copyString( function, stack.function.data(), stack.function.size() );
+    return stack;
+}
+packed_stack_view::packed_stack_view( const char *data, size_t N ) : d_data( data )
+{
+    if ( N < compactHeader || !isCompact( data ) )
+        throw std::logic_error( "Stack data is not in the compact format" );
+    if ( static_cast<uint8_t>( data[4] ) != compactVersion )
+        throw std::logic_error( "Unsupported stack data version" );
+    size_t bytes = readUInt32( &data[6] );
+    if ( bytes > N - compactHeader )
+        throw std::logic_error( "Corrupt stack data" );
+    d_end = data + compactHeader + bytes;
+    if ( compactChecksum( data + compactHeader, bytes ) != readUInt32( &data[10] ) )
+        throw std::logic_error( "Corrupt stack data" );
+    const char *ptr = data + compactHeader;
+    const char *end = d_end;
+    // Read the strings
+    uint64_t Ns = readVarint( ptr, end );
+    if ( Ns > static_cast<uint64_t>( end - ptr ) )
+        throw std::logic_error( "Corrupt stack data" );
+    std::vector<string_view> strings( Ns );
+    for ( auto &str : strings ) {
+        uint64_t len = readVarint( ptr, end );
+        if ( len > static_cast<uint64_t>( end - ptr ) )
+            throw std::logic_error( "Corrupt stack data" );
+        str = string_view( ptr, len );
+        ptr += len;
+    }
+    auto getString = [&strings, &ptr, end]() {
+        uint64_t id = readVarint( ptr, end );
+        if ( id >= strings.size() )
+            throw std::logic_error( "Corrupt stack data" );
+        return strings[id];
+    };
+    // Read the frames
+    uint64_t Nf = readVarint( ptr, end );
+    if ( Nf > static_cast<uint64_t>( end - ptr ) )
+        throw std::logic_error( "Corrupt stack data" );
+    d_frames.resize( Nf );
+    intptr_t address = 0, address2 = 0;
+    for ( auto &frame : d_frames ) {
+        address += readSigned( ptr, end );
+        address2 += readSigned( ptr, end );
+        frame.address      = reinterpret_cast<void *>( address );
+        frame.address2     = reinterpret_cast<void *>( address2 );
+        frame.line         = static_cast<uint32_t>( readVarint( ptr, end ) );
+        frame.object       = getString();
+        frame.objectPath   = getString();
+        frame.filename     = getString();
+        frame.filenamePath = getString();
+        frame.function     = getString();
+    }
+    d_tree = ptr;
+}
+// Read the header of a node (the frame id, count and number of children)
+namespace {
+struct packedNode {
+    uint64_t id;
+    int64_t N;
+    uint64_t Nc;
+};
+} // namespace
+static packedNode readNode( const char *&ptr, const char *end, size_t Nf )
+{
+    packedNode node;
+    node.id = readVarint( ptr, end );
+    node.N  = readSigned( ptr, end );
+    node.Nc = readVarint( ptr, end );
+    if ( node.id > Nf || node.Nc > static_cast<uint64_t>( end - ptr ) )
+        throw std::logic_error( "Corrupt stack data" );
+    return node;
+}
+int64_t packed_stack_view::N() const
+{
+    const char *ptr = d_tree;
+    return readNode( ptr, d_end, d_frames.size() ).N;
+}
+using visitFunction = std::function<void( int, int64_t, const packed_stack_view::frame * )>;
+static void visitTree( const char *&ptr, const char *end,
+                       const std::vector<packed_stack_view::frame> &frames, int depth,
+                       const visitFunction &fun )
+{
+    auto node = readNode( ptr, end, frames.size() );
+    fun( depth, node.N, node.id > 0 ? &frames[node.id - 1] : nullptr );
+    for ( uint64_t i = 0; i < node.Nc; i++ )
+        visitTree( ptr, end, frames, depth + 1, fun );
+}
+void packed_stack_view::visit( const visitFunction &fun ) const
+{
+    const char *ptr = d_tree;
+    visitTree( ptr, d_end, d_frames, 0, fun );
+}
+static void printTree( const char *&ptr, const char *end, const std::vector<std::string> &text,
+                       std::string &prefix, bool c, std::string &out )
+{
+    auto node     = readNode( ptr, end, text.size() );
+    size_t length = prefix.size();
+    if ( node.id > 0 ) {
+        char count[32];
+        snprintf( count, sizeof( count ), "[%lli] ", static_cast<long long>( node.N ) );
+        out += prefix;
+        out += count;
+        out += text[node.id - 1];
+        out += '\n';
+        prefix += c ? "| " : "  ";
+    }
+    for ( uint64_t i = 0; i < node.Nc; i++ ) {
+        bool c2 = node.Nc > 1 && i < node.Nc - 1 && node.id > 0;
+        printTree( ptr, end, text, prefix, c2, out );
+    }
+    prefix.resize( length );
+}
+std::string packed_stack_view::printString( const std::string &prefix ) const
+{
+    // Format each frame once
+    std::vector<stack_info> frames( d_frames.size() );
+    int w = 4;
+    for ( size_t i = 0; i < d_frames.size(); i++ ) {
+        frames[i] = d_frames[i].toStackInfo();
+        w         = std::max( w, frames[i].getAddressWidth() );
+    }
+    std::vector<std::string> text( d_frames.size() );
+    for ( size_t i = 0; i < d_frames.size(); i++ )
+        text[i] = frames[i].print( w, Internal::printWidthObject, Internal::printWidthFunction );
+    // Print the tree
+    std::string out, prefix2 = prefix;
+    const char *ptr = d_tree;
+    printTree( ptr, d_end, text, prefix2, false, out );
+    return out;
+}
+void packed_stack_view::print( std::ostream &out, const std::string &prefix ) const
+{
+    out << printString( prefix );
+    out.flush();
+}
+void packed_stack_view::addChildren( const char *&ptr, uint64_t Nc, multi_stack_info &stack,
+                                     std::vector<stack_info> &cache ) const
+{
+    for ( uint64_t i = 0; i < Nc; i++ ) {
+        auto node = readNode( ptr, d_end, d_frames.size() );
+        stack_info tmp;
+        const stack_info *frame = &tmp;
+        if ( node.id > 0 ) {
+            // The frames are only converted when they are needed
+            if ( cache[node.id - 1].address == nullptr )
+                cache[node.id - 1] = d_frames[node.id - 1].toStackInfo();
+            frame = &cache[node.id - 1];
+        }
+        size_t index = stack.getChild( *frame );
+        stack.children[index].N += node.N;
+        addChildren( ptr, node.Nc, stack.children[index], cache );
+    }
+}
+void packed_stack_view::addTo( multi_stack_info &stack ) const
+{
+    std::vector<stack_info> cache( d_frames.size() );
+    const char *ptr = d_tree;
+    auto root       = readNode( ptr, d_end, d_frames.size() );
+    stack.N += root.N;
+    addChildren( ptr, root.Nc, stack, cache );
+}
+static void unpackTree( const char *&ptr, const char *end,
+                        const std::vector<packed_stack_view::frame> &frames,
+                        StackTrace::multi_stack_info &stack )
+{
+    auto node = readNode( ptr, end, frames.size() );
+    stack.clear();
+    if ( node.id > 0 )
+        stack.stack = frames[node.id - 1].toStackInfo();
+    stack.N = node.N;
+    stack.children.resize( node.Nc );
+    for ( auto &child : stack.children )
+        unpackTree( ptr, end, frames, child );
+}
+StackTrace::multi_stack_info packed_stack_view::unpack() const
+{
+    multi_stack_info stack;
+    const char *ptr = d_tree;
+    unpackTree( ptr, d_end, d_frames, stack );
+    return stack;
+}
+static const char *checkLegacy( const char *ptr, const char *end )
+{
+    constexpr size_t bytes = 2 * sizeof( int ) + sizeof( StackTrace::stack_info );
+    if ( static_cast<size_t>( end - ptr ) < bytes )
+        throw std::logic_error( "Corrupt stack data" );
+    int Nc;
+    memcpy( &Nc, ptr + bytes - sizeof( int ), sizeof( int ) );
+    if ( Nc < 0 )
+        throw std::logic_error( "Corrupt stack data" );
+    ptr += bytes;
+    for ( int i = 0; i < Nc; i++ )
+        ptr = checkLegacy( ptr, end );
+    return ptr;
+}
+const char *StackTrace::multi_stack_info::unpack( const char *ptr, size_t N )
+{
+    if ( N >= compactHeader && isCompact( ptr ) ) {
+        packed_stack_view view( ptr, N );
+        *this = view.unpack();
+        return ptr + view.size();
+    }
+    checkLegacy( ptr, ptr + N );
+    return unpack( ptr );
+}
 const char *StackTrace::multi_stack_info::unpack( const char *ptr )
 {
     int N2, Nc;
@@ -539,10 +1068,290 @@ const char *StackTrace::multi_stack_info::unpack( const char *ptr )
     children.resize( Nc );
     for ( auto &tmp : children )
         ptr = tmp.unpack( ptr );
+    invalidateIndex();
     return ptr;
 }
 
 
+/****************************************************************************
+ *  Merge stacks in parallel                                                 *
+ *  Note: the partial trees are built for contiguous blocks and merged in    *
+ *    order so the result (including the order of the children) is the same  *
+ *    as adding the stacks sequentially                                      *
+ ****************************************************************************/
+static constexpr size_t minStacksPerThread      = 256;
+static constexpr size_t minPackedBytesPerThread = 64 * 1024;
+template<class FUN>
+static void parallelFor( size_t N, int threads, FUN &&fun )
+{
+    size_t Nt = std::min<size_t>( std::max( threads, 1 ), N );
+    if ( Nt <= 1 ) {
+        for ( size_t i = 0; i < N; i++ )
+            fun( i );
+        return;
+    }
+    std::atomic<size_t> next( 0 );
+    auto run = [&next, &fun, N]() {
+        for ( size_t i = next++; i < N; i = next++ )
+            fun( i );
+    };
+    std::vector<std::thread> workers( Nt - 1 );
+    for ( auto &worker : workers )
+        worker = std::thread( run );
+    run();
+    for ( auto &worker : workers )
+        worker.join();
+}
+static int getThreadCount( int threads )
+{
+    if ( threads <= 0 )
+        threads = std::thread::hardware_concurrency();
+    return std::max( threads, 1 );
+}
+static void reduceStacks( std::vector<StackTrace::multi_stack_info> &data, int threads )
+{
+    for ( size_t step = 1; step < data.size(); step *= 2 ) {
+        size_t N = ( data.size() + 2 * step - 1 ) / ( 2 * step );
+        parallelFor( N, threads, [&data, step]( size_t i ) {
+            size_t j = 2 * step * i;
+            if ( j + step < data.size() )
+                data[j].add( std::move( data[j + step] ) );
+        } );
+    }
+}
+StackTrace::multi_stack_info
+StackTrace::mergeStacks( const std::vector<std::vector<stack_info>> &stacks, int threads )
+{
+    size_t N  = stacks.size();
+    size_t Nt = std::min<size_t>( getThreadCount( threads ), N / minStacksPerThread );
+    Nt        = std::max<size_t>( Nt, 1 );
+    std::vector<multi_stack_info> partial( Nt );
+    parallelFor( Nt, Nt, [&stacks, &partial, N, Nt]( size_t i ) {
+        for ( size_t j = i * N / Nt; j < ( i + 1 ) * N / Nt; j++ )
+            partial[i].add( stacks[j].size(), stacks[j].data() );
+    } );
+    reduceStacks( partial, Nt );
+    partial[0].N = N;
+    return std::move( partial[0] );
+}
+StackTrace::multi_stack_info StackTrace::mergeStacks( std::vector<multi_stack_info> stacks,
+                                                      int threads )
+{
+    if ( stacks.empty() )
+        return multi_stack_info();
+    // Note: the root frame is not merged (the same as adding to an empty stack)
+    reduceStacks( stacks, getThreadCount( threads ) );
+    stacks[0].stack.clear();
+    return std::move( stacks[0] );
+}
+StackTrace::multi_stack_info
+StackTrace::mergeStacks( const std::vector<packed_stack_view> &stacks, int threads )
+{
+    // Note: the views can contain any number of stacks, so the threshold uses the total size
+    size_t N     = stacks.size();
+    size_t bytes = 0;
+    for ( const auto &stack : stacks )
+        bytes += stack.size();
+    size_t Nt = std::min<size_t>( getThreadCount( threads ), N );
+    Nt        = std::min<size_t>( Nt, bytes / minPackedBytesPerThread );
+    Nt        = std::max<size_t>( Nt, 1 );
+    std::vector<multi_stack_info> partial( Nt );
+    parallelFor( Nt, Nt, [&stacks, &partial, N, Nt]( size_t i ) {
+        for ( size_t j = i * N / Nt; j < ( i + 1 ) * N / Nt; j++ )
+            stacks[j].addTo( partial[i] );
+    } );
+    reduceStacks( partial, Nt );
+    return std::move( partial[0] );
+}
+
+
+/****************************************************************************
+ *  Bounded aggregation                                                      *
+ ****************************************************************************/
+const StackTrace::stack_info &StackTrace::multi_stack_info::otherFrame()
+{
+    // Note: the address is not a valid code address but is non-zero so the frame is printed
+    static const stack_info frame = [] {
+        stack_info tmp;
+        tmp.address  = reinterpret_cast<void *>( 1 );
+        tmp.address2 = tmp.address;
+        copy( "[other]", tmp.function );
+        return tmp;
+    }();
+    return frame;
+}
+size_t StackTrace::multi_stack_info::numberOfNodes() const
+{
+    size_t N = 1;
+    for ( const auto &child : children )
+        N += child.numberOfNodes();
+    return N;
+}
+static inline bool isOther( const StackTrace::stack_info &stack )
+{
+    return stack.address == StackTrace::multi_stack_info::otherFrame().address;
+}
+// Memory for the array of children and the index of a node
+size_t StackTrace::multi_stack_info::getLocalMemory() const
+{
+    return children.capacity() * sizeof( multi_stack_info ) +
+           d_index.table.capacity() * sizeof( childIndex::slot );
+}
+size_t StackTrace::multi_stack_info::memoryUsage() const
+{
+    size_t bytes = sizeof( multi_stack_info ) + getLocalMemory();
+    for ( const auto &child : children )
+        bytes += child.memoryUsage() - sizeof( multi_stack_info );
+    return bytes;
+}
+// Number of nodes and the memory of the children after removing the children with
+//   N <= threshold (nodes that remove children are rebuilt with an exact capacity and
+//   no index, see pruneChildren)
+void StackTrace::multi_stack_info::getPrunedSize( int64_t threshold, size_t &nodes,
+                                                  size_t &bytes ) const
+{
+    size_t Nc    = 0;
+    bool removed = false;
+    nodes++;
+    for ( const auto &child : children ) {
+        if ( isOther( child.stack ) || child.N <= threshold ) {
+            removed = true;
+        } else {
+            Nc++;
+            child.getPrunedSize( threshold, nodes, bytes );
+        }
+    }
+    if ( removed ) {
+        nodes++;
+        bytes += ( Nc + 1 ) * sizeof( multi_stack_info );
+    } else {
+        bytes += getLocalMemory();
+    }
+}
+static void getCounts( const StackTrace::multi_stack_info &stack, std::vector<int64_t> &counts )
+{
+    for ( const auto &child : stack.children ) {
+        counts.push_back( child.N );
+        getCounts( child, counts );
+    }
+}
+void StackTrace::multi_stack_info::pruneChildren( int64_t threshold, int depth )
+{
+    bool removed = depth <= 0 && !children.empty();
+    for ( const auto &child : children )
+        removed = removed || isOther( child.stack ) || child.N <= threshold;
+    if ( !removed ) {
+        for ( auto &child : children )
+            child.pruneChildren( threshold, depth - 1 );
+        return;
+    }
+    // Move the children that are removed to [other]
+    int64_t other = 0;
+    size_t Nc     = 1;
+    for ( const auto &child : children )
+        Nc += depth > 0 && !isOther( child.stack ) && child.N > threshold;
+    std::vector<multi_stack_info> children2;
+    children2.reserve( Nc );
+    for ( auto &child : children ) {
+        if ( depth <= 0 || isOther( child.stack ) || child.N <= threshold ) {
+            other += child.N;
+        } else {
+            child.pruneChildren( threshold, depth - 1 );
+            children2.push_back( std::move( child ) );
+        }
+    }
+    if ( other > 0 ) {
+        children2.resize( children2.size() + 1 );
+        children2.back().N     = other;
+        children2.back().stack = otherFrame();
+    }
+    children = std::move( children2 );
+    invalidateIndex();
+}
+void StackTrace::multi_stack_info::prune( size_t maxNodes, int maxDepth )
+{
+    pruneToSize( maxNodes, std::numeric_limits<size_t>::max(), maxDepth );
+}
+void StackTrace::multi_stack_info::pruneToSize( size_t maxNodes, size_t maxBytes, int maxDepth )
+{
+    // Truncate the paths
+    pruneChildren( std::numeric_limits<int64_t>::min(), maxDepth );
+    auto fits = [this, maxNodes, maxBytes]( int64_t threshold ) {
+        size_t nodes = 0, bytes = sizeof( multi_stack_info );
+        getPrunedSize( threshold, nodes, bytes );
+        return nodes <= maxNodes && bytes <= maxBytes;
+    };
+    if ( children.empty() || fits( std::numeric_limits<int64_t>::min() ) )
+        return;
+    // Find the smallest threshold that fits and remove the children
+    // Note: if nothing fits all children are moved to [other]
+    std::vector<int64_t> counts;
+    getCounts( *this, counts );
+    std::sort( counts.begin(), counts.end() );
+    counts.erase( std::unique( counts.begin(), counts.end() ), counts.end() );
+    size_t i0 = 0, i1 = counts.size() - 1;
+    while ( i0 < i1 ) {
+        size_t i = ( i0 + i1 ) / 2;
+        if ( fits( counts[i] ) )
+            i1 = i;
+        else
+            i0 = i + 1;
+    }
+    pruneChildren( counts[i0], maxDepth );
+}
+
+
+StackTrace::bounded_stack_info::bounded_stack_info( size_t maxNodes, size_t maxBytes,
+                                                    int maxDepth )
+    : d_nodes( 1 ),
+      d_bytes( sizeof( multi_stack_info ) ),
+      d_maxNodes( std::max<size_t>( maxNodes, 2 ) ),
+      d_maxBytes( std::max<size_t>( maxBytes, 4 * sizeof( multi_stack_info ) ) ),
+      d_maxDepth( std::max( maxDepth, 0 ) )
+{
+}
+void StackTrace::bounded_stack_info::clear()
+{
+    d_stack.clear();
+    d_nodes = 1;
+    d_bytes = d_stack.memoryUsage();
+}
+void StackTrace::bounded_stack_info::prune()
+{
+    d_stack.pruneToSize( d_maxNodes - d_maxNodes / 4, d_maxBytes - d_maxBytes / 4, d_maxDepth );
+    d_nodes = d_stack.numberOfNodes();
+    d_bytes = d_stack.memoryUsage();
+}
+void StackTrace::bounded_stack_info::add( size_t len, const stack_info *stack, int64_t count )
+{
+    // Add the frames (counting the new nodes and the growth of the arrays)
+    d_stack.N += count;
+    auto node    = &d_stack;
+    size_t depth = std::min<size_t>( len, d_maxDepth );
+    for ( size_t i = 0; i <= depth && i < len; i++ ) {
+        const auto &frame = i < depth ? stack[len - 1 - i] : multi_stack_info::otherFrame();
+        size_t Nc         = node->children.size();
+        size_t bytes      = node->getLocalMemory();
+        size_t j          = node->getChild( frame );
+        d_nodes += node->children.size() - Nc;
+        d_bytes += node->getLocalMemory() - bytes;
+        node = &node->children[j];
+        node->N += count;
+    }
+    if ( d_nodes > d_maxNodes || d_bytes > d_maxBytes )
+        prune();
+}
+void StackTrace::bounded_stack_info::add( const multi_stack_info &stack )
+{
+    d_stack.add( stack );
+    d_stack.pruneChildren( std::numeric_limits<int64_t>::min(), d_maxDepth );
+    d_nodes = d_stack.numberOfNodes();
+    d_bytes = d_stack.memoryUsage();
+    if ( d_nodes > d_maxNodes || d_bytes > d_maxBytes )
+        prune();
+}
+
+
 /****************************************************************************
  *  Function to get the executable name                                      *
  ****************************************************************************/
@@ -759,7 +1568,7 @@ static void getFileAndLineObject( staticVector<StackTrace::stack_info*,blockSize
                 continue;
             }
             // get function name
-            if ( info[i]->function.empty() ) {
+            if ( info[i]->function[0] == 0 ) {
                 cleanupFunctionName( tmp1 );
                 copy( tmp1, info[i]->function );
             }
@@ -978,13 +1787,46 @@ std::vector<StackTrace::stack_info> StackTrace::getStackInfo( const std::vector<
 /****************************************************************************
 *  Helper functions for controlling interal signals                         *
 ****************************************************************************/
-static int backtrace_thread( const std::thread::native_handle_type&, void**, size_t );
+static constexpr int maxStackFrames = 1024;
+static int findFrame( void* const* trace, int count, const void* address )
+{
+    for ( int i = 0; i < count && address; i++ ) {
+        if ( trace[i] == address )
+            return i;
+    }
+    return 0;
+}
 #if defined( USE_LINUX ) || defined( USE_MAC )
-static int global_thread_backtrace_count;
-static void* global_thread_backtrace[1000];
-static void _callstack_signal_handler( int, siginfo_t*, void* )
+static void* getSignalAddress( void* context )
+{
+    // Return the instruction that was interrupted by the signal
+    #if defined( USE_LINUX ) && defined( __x86_64__ )
+        auto ucontext = static_cast<ucontext_t*>( context );
+        return reinterpret_cast<void*>( ucontext->uc_mcontext.gregs[REG_RIP] );
+    #elif defined( USE_LINUX ) && defined( __aarch64__ )
+        auto ucontext = static_cast<ucontext_t*>( context );
+        return reinterpret_cast<void*>( ucontext->uc_mcontext.pc );
+    #else
+        NULL_USE( context );
+        return nullptr;
+    #endif
+}
+static volatile int global_thread_backtrace_count;
+static int global_thread_backtrace_size;
+static void* global_thread_backtrace[maxStackFrames];
+int StackTrace::Internal::backtrace_signal( void** buffer, int size, void* context )
+{
+    // Get the backtrace and remove the frames for the signal handler
+    int count = ::backtrace( buffer, size );
+    int start = findFrame( buffer, count, getSignalAddress( context ) );
+    for ( int i = start; i < count; i++ )
+        buffer[i - start] = buffer[i];
+    return count - start;
+}
+static void _callstack_signal_handler( int, siginfo_t*, void* context )
 {
-    global_thread_backtrace_count = backtrace_thread( StackTrace::thisThread(), global_thread_backtrace, 1000 );
+    global_thread_backtrace_count = StackTrace::Internal::backtrace_signal(
+        global_thread_backtrace, global_thread_backtrace_size, context );
 }
 static int get_thread_callstack_signal()
 {
@@ -1000,24 +1842,40 @@ int thread_callstack_signal = 0;
 
 /****************************************************************************
  *  Function to get the backtrace                                            *
+ *  Note: the frames belonging to StackTrace are removed from the top of the *
+ *    stack using the return address of the caller (current thread) or the   *
+ *    interrupted instruction (other threads).  At most skip+maxDepth frames *
+ *    (plus a few internal frames) are unwound.                              *
  ****************************************************************************/
-static int backtrace_thread(
-    const std::thread::native_handle_type &tid, void **buffer, size_t size )
+#if defined( __GNUC__ )
+    #define RETURN_ADDRESS() __builtin_return_address( 0 )
+#else
+    #define RETURN_ADDRESS() nullptr
+#endif
+static int backtrace_thread( const std::thread::native_handle_type &tid, void **buffer,
+                             int maxDepth, int skip, const void *caller )
 {
+    maxDepth  = std::max( std::min( maxDepth, maxStackFrames ), 0 );
+    skip      = std::max( skip, 0 );
+    int size  = std::min( maxDepth + skip + 8, maxStackFrames );
     int count = 0;
 #if defined( USE_LINUX ) || defined( USE_MAC )
     // Get the trace
+    void *trace[maxStackFrames];
+    int start = 0;
     if ( tid == pthread_self() ) {
-        count = ::backtrace( buffer, size );
+        count = ::backtrace( trace, size );
+        start = findFrame( trace, count, caller );
     } else {
         // Note: this will get the backtrace, but terminates the thread in the process!!!
         StackTrace_mutex.lock();
         struct sigaction sa;
         sigfillset( &sa.sa_mask );
-        sa.sa_flags     = SA_SIGINFO;
+        sa.sa_flags     = SA_SIGINFO | SA_RESTART;
         sa.sa_sigaction = _callstack_signal_handler;
         sigaction( thread_callstack_signal, &sa, nullptr );
         global_thread_backtrace_count = -1;
+        global_thread_backtrace_size  = size;
         pthread_kill( tid, thread_callstack_signal );
         auto t1 = std::chrono::high_resolution_clock::now();
         auto t2 = std::chrono::high_resolution_clock::now();
@@ -1026,11 +1884,16 @@ static int backtrace_thread(
             std::this_thread::yield();
             t2 = std::chrono::high_resolution_clock::now();
         }
-        count = std::max( global_thread_backtrace_count, 0 );
-        memcpy( buffer, global_thread_backtrace, count * sizeof( void * ) );
+        count = global_thread_backtrace_count;
+        count = std::max( count, 0 );
+        memcpy( trace, global_thread_backtrace, count * sizeof( void * ) );
         global_thread_backtrace_count = -1;
         StackTrace_mutex.unlock();
     }
+    // Skip the requested frames
+    start += skip;
+    count = std::max( std::min( count - start, maxDepth ), 0 );
+    memcpy( buffer, &trace[start], count * sizeof( void * ) );
 #elif defined( USE_WINDOWS )
 #if defined( DBGHELP )
 
@@ -1075,7 +1938,7 @@ static int backtrace_thread(
 #endif
 
     auto pid = GetCurrentProcess();
-    for ( int frameNum = 0; frameNum < 1024; ++frameNum ) {
+    for ( int frameNum = 0; frameNum < 1024 && count < maxDepth; ++frameNum ) {
         BOOL rtn = StackWalk64( imageType, pid, tid, &frame, &context, readProcMem,
             SymFunctionTableAccess, SymGetModuleBase64, NULL );
         if ( !rtn ) {
@@ -1096,31 +1959,35 @@ static int backtrace_thread(
 #endif
     return count;
 }
-std::vector<void *> StackTrace::backtrace( std::thread::native_handle_type tid )
+static std::vector<void *> backtrace2( const std::thread::native_handle_type &tid, int maxDepth,
+                                       int skip, const void *caller )
 {
-    std::vector<void *> trace( 1000, nullptr );
-    size_t count = backtrace_thread( tid, trace.data(), trace.size() );
+    std::vector<void *> trace( std::max( std::min( maxDepth, maxStackFrames ), 0 ), nullptr );
+    size_t count = backtrace_thread( tid, trace.data(), maxDepth, skip, caller );
     trace.resize( count );
     return trace;
 }
+std::vector<void *> StackTrace::backtrace( std::thread::native_handle_type tid )
+{
+    return backtrace2( tid, 1000, 0, RETURN_ADDRESS() );
+}
+std::vector<void *>
+StackTrace::backtrace( std::thread::native_handle_type tid, int maxDepth, int skip )
+{
+    return backtrace2( tid, maxDepth, skip, RETURN_ADDRESS() );
+}
 std::vector<void *> StackTrace::backtrace()
 {
-    std::vector<void *> trace( 1000, nullptr );
-    size_t count = backtrace_thread( thisThread(), trace.data(), trace.size() );
-    trace.resize( count );
-    return trace;
+    return backtrace2( thisThread(), 1000, 0, RETURN_ADDRESS() );
 }
-std::vector<std::vector<void *>> StackTrace::backtraceAll()
+std::vector<std::vector<void *>> StackTrace::backtraceAll( int maxDepth, int skip )
 {
     // Get the list of threads
     auto threads = registeredThreads();
     // Get the backtrace of each thread
     std::vector<std::vector<void *>> trace( threads.size() );
-    for ( size_t i = 0; i < threads.size(); i++ ) {
-        trace[i].resize( 1000 );
-        size_t count = backtrace_thread( threads[i], trace[i].data(), trace[i].size() );
-        trace[i].resize( count );
-    }
+    for ( size_t i = 0; i < threads.size(); i++ )
+        trace[i] = backtrace2( threads[i], maxDepth, skip, RETURN_ADDRESS() );
     return trace;
 }
 
@@ -1128,42 +1995,43 @@ std::vector<std::vector<void *>> StackTrace::backtraceAll()
 /****************************************************************************
  *  Function to get the current call stack                                   *
  ****************************************************************************/
-std::vector<StackTrace::stack_info> StackTrace::getCallStack()
+static std::vector<StackTrace::stack_info> getCallStack2( const std::thread::native_handle_type &tid,
+                                                          int maxDepth, int skip,
+                                                          const void *caller )
 {
-    void *trace[1000];
-    size_t count = backtrace_thread( thisThread(), trace, 1000 );
+    void *trace[maxStackFrames];
+    size_t count = backtrace_thread( tid, trace, maxDepth, skip, caller );
     std::vector<StackTrace::stack_info> info( count );
     getStackInfo2( count, trace, info.data() );
     return info;
 }
+std::vector<StackTrace::stack_info> StackTrace::getCallStack()
+{
+    return getCallStack2( thisThread(), 1000, 0, RETURN_ADDRESS() );
+}
 std::vector<StackTrace::stack_info> StackTrace::getCallStack( std::thread::native_handle_type id )
 {
-    void *trace[1000];
-    size_t count = backtrace_thread( id, trace, 1000 );
-    std::vector<StackTrace::stack_info> info( count );
-    getStackInfo2( count, trace, info.data() );
-    return info;
+    return getCallStack2( id, 1000, 0, RETURN_ADDRESS() );
+}
+std::vector<StackTrace::stack_info>
+StackTrace::getCallStack( std::thread::native_handle_type id, int maxDepth, int skip )
+{
+    return getCallStack2( id, maxDepth, skip, RETURN_ADDRESS() );
 }
 static std::vector<std::vector<StackTrace::stack_info>> generateStacks(
     const std::vector<std::vector<void *>> &trace )
 {
-    // Function to find an address
-    auto find = []( const auto &data, auto x ) {
-        for ( size_t i = 0; i < data.size(); i++ ) {
-            if ( data[i] == x )
-                return static_cast<int>( i );
-        }
-        return -1;
-    };
-    // Get the stack data for all pointers
+    // Get the unique addresses (sorted so each frame can be found with a binary search)
+    size_t N = 0;
+    for ( const auto &tmp : trace )
+        N += tmp.size();
     std::vector<void *> addresses;
-    addresses.reserve( 1024 );
-    for ( const auto &tmp : trace ) {
-        for ( auto ptr : tmp ) {
-            if ( find( addresses, ptr ) == -1 )
-                addresses.push_back( ptr );
-        }
-    }
+    addresses.reserve( N );
+    for ( const auto &tmp : trace )
+        addresses.insert( addresses.end(), tmp.begin(), tmp.end() );
+    std::sort( addresses.begin(), addresses.end() );
+    addresses.erase( std::unique( addresses.begin(), addresses.end() ), addresses.end() );
+    // Get the stack data for all pointers
     auto stack_data = StackTrace::getStackInfo( addresses );
     // Create the stack traces
     std::vector<std::vector<StackTrace::stack_info>> stack( trace.size() );
@@ -1171,8 +2039,8 @@ static std::vector<std::vector<StackTrace::stack_info>> generateStacks(
         // Create the stack for the given thread trace
         stack[i].resize( trace[i].size() );
         for ( size_t j = 0; j < trace[i].size(); j++ ) {
-            int k       = find( addresses, trace[i][j] );
-            stack[i][j] = stack_data[k];
+            auto it     = std::lower_bound( addresses.begin(), addresses.end(), trace[i][j] );
+            stack[i][j] = stack_data[it - addresses.begin()];
         }
     }
     return stack;
@@ -1183,33 +2051,284 @@ static StackTrace::multi_stack_info generateMultiStack(
     // Get the stack data for all pointers
     auto stack = generateStacks( trace );
     // Create the multi-stack trace
-    StackTrace::multi_stack_info multistack;
-    multistack.N = stack.size();
-    for ( const auto &tmp : stack )
-        multistack.add( tmp.size(), tmp.data() );
-    return multistack;
+    return StackTrace::mergeStacks( stack );
 }
-static StackTrace::multi_stack_info generateMultiStack(
-    const std::vector<std::thread::native_handle_type> &threads )
+static StackTrace::multi_stack_info
+generateMultiStack( const std::vector<std::thread::native_handle_type> &threads,
+                    int maxDepth = 1000, int skip = 0, const void *caller = nullptr )
 {
     // Get the stack data for all pointers
     std::vector<std::vector<void *>> trace( threads.size() );
     auto it = threads.begin();
     for ( size_t i = 0; i < threads.size(); i++, ++it )
-        trace[i] = StackTrace::backtrace( *it );
+        trace[i] = backtrace2( *it, maxDepth, skip, caller );
     // Create the multi-stack trace
     return generateMultiStack( trace );
 }
-StackTrace::multi_stack_info StackTrace::getAllCallStacks()
+StackTrace::multi_stack_info StackTrace::getAllCallStacks( int maxDepth, int skip )
 {
     // Get the list of active thread
     auto threads = registeredThreads();
     // Create the multi-stack structure
-    auto stack = generateMultiStack( threads );
+    auto stack = generateMultiStack( threads, maxDepth, skip, RETURN_ADDRESS() );
     return stack;
 }
 
 
+/****************************************************************************
+ *  Function to get the call stack of another process                        *
+ *  Note: the threads are stopped with ptrace and unwound from outside the   *
+ *    process using the frame pointers (if availible).  If the chain of      *
+ *    frame pointers breaks the rest of the stack is scanned for return      *
+ *    addresses.  These frames are heuristic (they may include return        *
+ *    addresses of dead frames) and are placed below a [stack scan] frame.   *
+ ****************************************************************************/
+#if defined( USE_LINUX ) && ( defined( __x86_64__ ) || defined( __aarch64__ ) )
+namespace {
+// Marker for the frames found by scanning the stack (not a valid code address)
+static void *const scanMarker = reinterpret_cast<void *>( 2 );
+struct processMap {
+    uint64_t start  = 0;
+    uint64_t end    = 0;
+    uint64_t offset = 0;
+    bool exec       = false;
+    std::array<char, 512> path;
+};
+class remoteProcess
+{
+public:
+    explicit remoteProcess( int pid ) : d_pid( pid ) { readMaps(); }
+    // Read memory from the process
+    size_t read( uint64_t address, void *buf, size_t bytes ) const
+    {
+        iovec local  = { buf, bytes };
+        iovec remote = { reinterpret_cast<void *>( address ), bytes };
+        auto N       = process_vm_readv( d_pid, &local, 1, &remote, 1, 0 );
+        return N < 0 ? 0 : N;
+    }
+    // Find the map containing the address
+    const processMap *find( uint64_t address ) const
+    {
+        auto it = std::upper_bound( d_maps.begin(), d_maps.end(), address,
+                                    []( uint64_t x, const processMap &m ) { return x < m.start; } );
+        if ( it == d_maps.begin() )
+            return nullptr;
+        --it;
+        return address < it->end ? &( *it ) : nullptr;
+    }
+    // Check if the address is the return address of a call instruction
+    bool isReturnAddress( uint64_t address )
+    {
+        auto it = d_returnCache.find( address );
+        if ( it != d_returnCache.end() )
+            return it->second;
+        bool valid = false;
+        auto map   = find( address );
+        if ( map && map->exec && address >= map->start + 8 ) {
+            uint8_t code[8] = { 0 };
+            if ( read( address - 8, code, 8 ) == 8 ) {
+    #if defined( __x86_64__ )
+                // call rel32 or an indirect call (ff /2)
+                valid = code[3] == 0xE8;
+                for ( int k : { 2, 3, 4, 6, 7 } )
+                    valid = valid || ( code[8 - k] == 0xFF && ( ( code[9 - k] >> 3 ) & 7 ) == 2 );
+    #elif defined( __aarch64__ )
+                // bl or blr
+                uint32_t insn;
+                memcpy( &insn, &code[4], 4 );
+                valid = ( insn & 0xFC000000 ) == 0x94000000 || ( insn & 0xFFFFFC1F ) == 0xD63F0000;
+    #endif
+            }
+        }
+        d_returnCache[address] = valid;
+        return valid;
+    }
+    // Unwind a stopped thread
+    std::vector<void *> unwind( int tid )
+    {
+        constexpr size_t maxDepth = 1000;
+        std::vector<void *> trace;
+        user_regs_struct regs;
+        iovec iov = { &regs, sizeof( regs ) };
+        if ( ptrace( PTRACE_GETREGSET, tid, NT_PRSTATUS, &iov ) != 0 )
+            return trace;
+    #if defined( __x86_64__ )
+        uint64_t pc = regs.rip, sp = regs.rsp, fp = regs.rbp, lr = 0;
+    #elif defined( __aarch64__ )
+        uint64_t pc = regs.pc, sp = regs.sp, fp = regs.regs[29], lr = regs.regs[30];
+    #endif
+        auto add = [&trace]( uint64_t x ) { trace.push_back( reinterpret_cast<void *>( x ) ); };
+        add( pc );
+        // Copy the stack
+        auto map = find( sp );
+        if ( !map )
+            return trace;
+        std::vector<uint64_t> stack( std::min<uint64_t>( map->end - sp, 0x80000 ) / 8 );
+        stack.resize( read( sp, stack.data(), 8 * stack.size() ) / 8 );
+        auto load = [&stack, sp]( uint64_t address, uint64_t &value ) {
+            if ( address < sp || address % 8 != 0 || ( address - sp ) / 8 >= stack.size() )
+                return false;
+            value = stack[( address - sp ) / 8];
+            return true;
+        };
+        // Get the return address of the current function (only availible in a register)
+        // Note: if the current function does not have a frame its caller is skipped
+        uint64_t ret = 0, next = 0;
+        if ( lr != 0 && isReturnAddress( lr ) )
+            add( lr );
+        // Follow the frame pointers until the outermost frame (next == 0)
+        uint64_t pos = sp;
+        bool broken  = true;
+        while ( trace.size() < maxDepth && load( fp, next ) && load( fp + 8, ret ) ) {
+            if ( !isReturnAddress( ret ) )
+                break;
+            if ( reinterpret_cast<uint64_t>( trace.back() ) != ret )
+                add( ret );
+            pos    = fp + 16;
+            broken = next != 0;
+            if ( next <= fp )
+                break;
+            fp = next;
+        }
+        // Frame pointers are frequently omitted, scan the rest of the stack
+        if ( broken && trace.size() < maxDepth )
+            trace.push_back( scanMarker );
+        for ( ; broken && trace.size() < maxDepth && load( pos, ret ); pos += 8 ) {
+            if ( isReturnAddress( ret ) && reinterpret_cast<uint64_t>( trace.back() ) != ret )
+                add( ret );
+        }
+        if ( trace.back() == scanMarker )
+            trace.pop_back();
+        return trace;
+    }
+    // Get the stack info for the addresses
+    std::vector<StackTrace::stack_info> getStackInfo( const std::vector<void *> &addresses ) const
+    {
+        std::vector<StackTrace::stack_info> info( addresses.size() );
+        for ( size_t i = 0; i < addresses.size(); i++ ) {
+            auto address    = reinterpret_cast<uint64_t>( addresses[i] );
+            info[i].address = addresses[i];
+            auto map        = find( address );
+            if ( !map )
+                continue;
+            info[i].address2 = reinterpret_cast<void *>( address - map->start + map->offset );
+            copy( map->path.data(), info[i].object, info[i].objectPath );
+        }
+        getFileAndLine( info.size(), info.data() );
+        for ( auto &tmp : info ) {
+            if ( tmp.address == scanMarker ) {
+                tmp.clear();
+                tmp.address  = scanMarker;
+                tmp.address2 = scanMarker;
+                copy( "[stack scan]", tmp.function );
+            }
+        }
+        return info;
+    }
+
+private:
+    void readMaps()
+    {
+        char filename[64];
+        sprintf( filename, "/proc/%i/maps", d_pid );
+        auto fid = fopen( filename, "r" );
+        if ( !fid )
+            return;
+        char line[4096];
+        while ( fgets( line, sizeof( line ), fid ) ) {
+            unsigned long long start = 0, end = 0, offset = 0;
+            char perms[8] = { 0 };
+            int pos       = 0;
+            if ( sscanf( line, "%llx-%llx %4s %llx %*s %*s%n", &start, &end, perms, &offset,
+                         &pos ) < 4 )
+                continue;
+            processMap map;
+            map.start  = start;
+            map.end    = end;
+            map.offset = offset;
+            map.exec   = perms[2] == 'x';
+            char *path = &line[pos];
+            while ( *path == ' ' )
+                path++;
+            path[strcspn( path, "\n" )] = 0;
+            copy( path, map.path );
+            d_maps.push_back( map );
+        }
+        fclose( fid );
+    }
+
+private:
+    int d_pid;
+    std::vector<processMap> d_maps;
+    std::map<uint64_t, bool> d_returnCache;
+};
+} // namespace
+static std::vector<int> getProcessThreads( int pid )
+{
+    std::vector<int> threads;
+    char path[64];
+    sprintf( path, "/proc/%i/task", pid );
+    auto dir = opendir( path );
+    if ( !dir )
+        return threads;
+    while ( auto entry = readdir( dir ) ) {
+        if ( entry->d_name[0] != '.' )
+            threads.push_back( atoi( entry->d_name ) );
+    }
+    closedir( dir );
+    std::sort( threads.begin(), threads.end() );
+    return threads;
+}
+StackTrace::multi_stack_info StackTrace::getProcessCallStacks( int pid )
+{
+    if ( pid == getpid() )
+        return getAllCallStacks();
+    // Attach to and stop all threads
+    std::vector<int> threads;
+    for ( auto tid : getProcessThreads( pid ) ) {
+        if ( ptrace( PTRACE_SEIZE, tid, nullptr, nullptr ) != 0 )
+            continue;
+        int status = 0;
+        if ( ptrace( PTRACE_INTERRUPT, tid, nullptr, nullptr ) == 0 &&
+             waitpid( tid, &status, __WALL ) == tid && WIFSTOPPED( status ) )
+            threads.push_back( tid );
+        else
+            ptrace( PTRACE_DETACH, tid, nullptr, nullptr );
+    }
+    // Unwind the threads and detach
+    remoteProcess process( pid );
+    std::vector<std::vector<void *>> trace;
+    for ( auto tid : threads )
+        trace.push_back( process.unwind( tid ) );
+    for ( auto tid : threads )
+        ptrace( PTRACE_DETACH, tid, nullptr, nullptr );
+    // Get the stack data for all pointers
+    std::vector<void *> addresses;
+    for ( const auto &tmp : trace )
+        addresses.insert( addresses.end(), tmp.begin(), tmp.end() );
+    std::sort( addresses.begin(), addresses.end() );
+    addresses.erase( std::unique( addresses.begin(), addresses.end() ), addresses.end() );
+    auto stack_data = process.getStackInfo( addresses );
+    // Create the multi-stack trace
+    StackTrace::multi_stack_info multistack;
+    multistack.N = trace.size();
+    std::vector<StackTrace::stack_info> stack;
+    for ( const auto &tmp : trace ) {
+        stack.resize( tmp.size() );
+        for ( size_t j = 0; j < tmp.size(); j++ ) {
+            size_t k = std::lower_bound( addresses.begin(), addresses.end(), tmp[j] ) -
+                       addresses.begin();
+            stack[j] = stack_data[k];
+        }
+        multistack.add( stack.size(), stack.data() );
+    }
+    return multistack;
+}
+#else
+StackTrace::multi_stack_info StackTrace::getProcessCallStacks( int ) { return {}; }
+#endif
+
+
 /****************************************************************************
  *  Function to get system search paths                                      *
  ****************************************************************************/
@@ -1525,7 +2644,9 @@ StackTrace::abort_error rethrow()
         error.bytes = StackTrace::Utilities::getMemoryUsage();
     if ( error.stack.empty() ) {
         error.stackType = StackTrace::printStackType::local;
-        error.stack     = StackTrace::backtrace();
+        error.stack     = StackTrace::backtrace( StackTrace::thisThread(),
+                                             StackTrace::getDefaultStackDepth(),
+                                             StackTrace::getDefaultStackSkip() );
     }
     return error;
 }
@@ -1535,7 +2656,8 @@ void StackTrace::terminateFunctionSignal( int sig )
     err.type      = StackTrace::terminateType::signal;
     err.signal    = sig;
     err.bytes     = StackTrace::Utilities::getMemoryUsage();
-    err.stack     = StackTrace::backtrace();
+    err.stack     = StackTrace::backtrace(
+        thisThread(), StackTrace::getDefaultStackDepth(), StackTrace::getDefaultStackSkip() );
     err.stackType = StackTrace::getDefaultStackType();
     abort_fun( err );
 }
@@ -1595,6 +2717,113 @@ void StackTrace::clearErrorHandler()
 }
 
 
+/****************************************************************************
+ *  Live stack dumps                                                         *
+ *  Note: the signal handler only writes to a pipe, the call stacks are      *
+ *    captured and written by a dedicated thread                             *
+ ****************************************************************************/
+#if defined( USE_LINUX ) || defined( USE_MAC )
+static int liveDumpPipe[2] = { -1, -1 };
+static int liveDumpSignal  = 0;
+static struct sigaction liveDumpOldAction;
+static std::shared_ptr<std::thread> liveDumpThread;
+static void liveDumpSignalHandler( int )
+{
+    int err = errno;
+    char c  = 1;
+    if ( write( liveDumpPipe[1], &c, 1 ) < 0 ) {
+        // The pipe is full (a dump is already pending)
+    }
+    errno = err;
+}
+static void writeLiveDump( const std::string &filename )
+{
+    auto stack = StackTrace::getAllCallStacks();
+    StackTrace::cleanupStackTrace( stack );
+    auto now = time( nullptr );
+    struct tm date;
+    char buf[64];
+    localtime_r( &now, &date );
+    strftime( buf, sizeof( buf ), "%a %b %e %H:%M:%S %Y", &date );
+    std::ofstream out( filename, std::ios::app );
+    out << "Stack dump at " << buf << std::endl;
+    stack.print( out );
+    out << std::endl;
+}
+static void runLiveDumpThread( const std::string &filename, const std::string &controlFile )
+{
+    while ( true ) {
+        // Wait for a request (a zero byte indicates we need to stop)
+        struct pollfd fd = { liveDumpPipe[0], POLLIN, 0 };
+        bool dump        = false;
+        if ( poll( &fd, 1, controlFile.empty() ? -1 : 1000 ) > 0 ) {
+            char buf[64];
+            auto N = read( liveDumpPipe[0], buf, sizeof( buf ) );
+            for ( int i = 0; i < N; i++ ) {
+                if ( buf[i] == 0 )
+                    return;
+                dump = true;
+            }
+        }
+        // Check the control file
+        if ( !controlFile.empty() && access( controlFile.data(), F_OK ) == 0 ) {
+            remove( controlFile.data() );
+            dump = true;
+        }
+        if ( dump )
+            writeLiveDump( filename );
+    }
+}
+void StackTrace::enableLiveDump( int signal, const std::string &path,
+                                 const std::string &controlFile )
+{
+    disableLiveDump();
+    // Note: the pipe is not inherited by child processes (e.g. addr2line)
+#ifdef USE_LINUX
+    if ( pipe2( liveDumpPipe, O_CLOEXEC ) != 0 )
+        throw std::runtime_error( "Unable to create pipe for live stack dumps" );
+#else
+    if ( pipe( liveDumpPipe ) != 0 )
+        throw std::runtime_error( "Unable to create pipe for live stack dumps" );
+    fcntl( liveDumpPipe[0], F_SETFD, FD_CLOEXEC );
+    fcntl( liveDumpPipe[1], F_SETFD, FD_CLOEXEC );
+#endif
+    fcntl( liveDumpPipe[1], F_SETFL, O_NONBLOCK );
+    auto filename  = path + "." + std::to_string( getpid() );
+    liveDumpThread = std::make_shared<std::thread>( runLiveDumpThread, filename, controlFile );
+    liveDumpSignal = signal;
+    if ( signal > 0 ) {
+        struct sigaction sa;
+        memset( &sa, 0, sizeof( sa ) );
+        sigemptyset( &sa.sa_mask );
+        sa.sa_flags   = SA_RESTART;
+        sa.sa_handler = liveDumpSignalHandler;
+        sigaction( signal, &sa, &liveDumpOldAction );
+    }
+}
+void StackTrace::disableLiveDump()
+{
+    if ( !liveDumpThread )
+        return;
+    if ( liveDumpSignal > 0 )
+        sigaction( liveDumpSignal, &liveDumpOldAction, nullptr );
+    char c = 0;
+    while ( write( liveDumpPipe[1], &c, 1 ) < 0 && errno == EAGAIN )
+        std::this_thread::yield();
+    liveDumpThread->join();
+    liveDumpThread.reset();
+    close( liveDumpPipe[0] );
+    close( liveDumpPipe[1] );
+    liveDumpPipe[0] = -1;
+    liveDumpPipe[1] = -1;
+    liveDumpSignal  = 0;
+}
+#else
+void StackTrace::enableLiveDump( int, const std::string &, const std::string & ) {}
+void StackTrace::disableLiveDump() {}
+#endif
+
+
 /****************************************************************************
  *  Functions to handle MPI errors                                           *
  ****************************************************************************/
@@ -1621,7 +2850,9 @@ static void MPI_error_handler_fun( MPI_Comm *comm, int *err, ... )
     error.message   = std::string( message );
     error.type      = StackTrace::terminateType::MPI;
     error.bytes     = StackTrace::Utilities::getMemoryUsage();
-    error.stack     = StackTrace::backtrace();
+    error.stack     = StackTrace::backtrace( StackTrace::thisThread(),
+                                         StackTrace::getDefaultStackDepth(),
+                                         StackTrace::getDefaultStackSkip() );
     error.stackType = StackTrace::printStackType::global;
     throw error;
 }
@@ -1679,11 +2910,9 @@ static void runGlobalMonitorThread()
             // Get the stack info for the threads
             auto multistack = generateMultiStack( threads );
             // Pack and send the data
-            size_t bytes = multistack.size();
-            char *data   = new char[bytes];
-            multistack.pack( data );
-            MPI_Send( data, bytes, MPI_CHAR, src_rank, tag, globalCommForGlobalCommStack );
-            delete[] data;
+            auto data = multistack.packCompact();
+            MPI_Send( data.data(), data.size(), MPI_CHAR, src_rank, tag,
+                      globalCommForGlobalCommStack );
         } else {
             // No requests recieved
             std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
@@ -1769,7 +2998,8 @@ StackTrace::multi_stack_info getRemoteCallStacks()
     auto start            = std::chrono::steady_clock::now();
     double time           = 0;
     const double max_time = 10.0 + size * 20e-3;
-    StackTrace::multi_stack_info multistack;
+    std::vector<std::vector<char>> data;
+    data.reserve( size );
     while ( N_finished < size && time < max_time ) {
         int flag = 0;
         MPI_Status status;
@@ -1782,12 +3012,9 @@ StackTrace::multi_stack_info getRemoteCallStacks()
             int src_rank = status.MPI_SOURCE;
             int count;
             MPI_Get_count( &status, MPI_CHAR, &count );
-            char *data = new char[count];
-            MPI_Recv( data, count, MPI_CHAR, src_rank, tag, globalCommForGlobalCommStack, &status );
-            StackTrace::multi_stack_info tmp;
-            tmp.unpack( data );
-            delete[] data;
-            multistack.add( tmp );
+            data.emplace_back( count );
+            MPI_Recv( data.back().data(), count, MPI_CHAR, src_rank, tag,
+                      globalCommForGlobalCommStack, &status );
             N_finished++;
         } else {
             auto stop = std::chrono::steady_clock::now();
@@ -1800,7 +3027,12 @@ StackTrace::multi_stack_info getRemoteCallStacks()
             continue;
         MPI_Request_free( &sendRequest[i] );
     }
-    return multistack;
+    // Merge the stacks (without unpacking them)
+    std::vector<StackTrace::packed_stack_view> views;
+    views.reserve( data.size() );
+    for ( const auto &tmp : data )
+        views.emplace_back( tmp.data(), tmp.size() );
+    return StackTrace::mergeStacks( views );
 }
 #else
 StackTrace::multi_stack_info getRemoteCallStacks() { return StackTrace::multi_stack_info(); }
@@ -2040,93 +3272,101 @@ static bool keep( const StackTrace::stack_info &info )
 }
 void StackTrace::cleanupStackTrace( multi_stack_info &stack )
 {
-    auto it           = stack.children.begin();
+    // Rebuild the children in a single pass: each child is filtered and collapsed,
+    //   cleaned (bottom up) and then merged with the first matching sibling
     const size_t npos = std::string::npos;
-    while ( it != stack.children.end() ) {
-        string_view object( it->stack.object.data() );
-        string_view function( it->stack.function.data() );
-        string_view filename( it->stack.filename.data() );
-        // Remove callstack (and all children) for threads that are just contributing
-        if ( filename == "StackTrace.cpp" ) {
-            bool test = function.find( "_callstack_signal_handler" ) != npos ||
-                        function.find( "getGlobalCallStacks" ) != npos ||
-                        function.find( "backtrace" ) != npos || function.find( "(" ) == npos;
-            if ( test ) {
-                it = stack.children.erase( it );
-                continue;
+    auto children     = std::move( stack.children );
+    stack.children.clear();
+    stack.children.reserve( children.size() );
+    stack.invalidateIndex();
+    for ( auto &child : children ) {
+        multi_stack_info *node = &child;
+        bool remove            = false;
+        while ( true ) {
+            string_view object( node->stack.object.data() );
+            string_view function( node->stack.function.data() );
+            string_view filename( node->stack.filename.data() );
+            // Remove callstack (and all children) for threads that are just contributing
+            if ( filename == "StackTrace.cpp" ) {
+                remove = function.find( "_callstack_signal_handler" ) != npos ||
+                         function.find( "getGlobalCallStacks" ) != npos ||
+                         function.find( "backtrace" ) != npos || function.find( "(" ) == npos;
+                if ( remove )
+                    break;
             }
-        }
-        // Remove libc fgets children
-        if ( object.find( "libc.so" ) != npos ) {
-            if ( function.find( "fgets" ) != npos )
-                it->children.clear();
-        }
-        // Identify if we want to print the current item
-        bool remove_entry = !keep( it->stack );
-        // Remove the desired entry
-        if ( remove_entry ) {
-            if ( it->children.empty() ) {
-                it = stack.children.erase( it );
-                continue;
-            } else if ( it->children.size() == 1 ) {
-                *it = it->children[0];
-                continue;
+            // Remove libc fgets children
+            if ( object.find( "libc.so" ) != npos ) {
+                if ( function.find( "fgets" ) != npos )
+                    node->children.clear();
             }
+            // Remove the entry if we do not want to print it (replacing it with a single child)
+            if ( keep( node->stack ) || node->children.size() > 1 )
+                break;
+            remove = node->children.empty();
+            if ( remove )
+                break;
+            node = &node->children[0];
         }
+        if ( remove )
+            continue;
         // Cleanup the children
-        cleanupStackTrace( *it );
+        cleanupStackTrace( *node );
         // Combine any children with the same address (can occur when we remove items)
-        bool remove = false;
-        for ( auto it2 = stack.children.begin(); it2 != it; it2++ ) {
-            if ( it->stack == it2->stack ) {
-                remove = true;
-                it2->N += it->N;
-                for ( auto &tmp : it->children )
-                    it2->children.push_back( tmp );
-                cleanupStackTrace( *it2 );
-            }
-        }
-        if ( remove ) {
-            it = stack.children.erase( it );
-            continue;
-        }
-        ++it;
+        stack.addChild( std::move( *node ) );
     }
 }
 
 
 /****************************************************************************
  *  Generate stack from string                                               *
+ *  Note: the lines are parsed in place (memchr is vectorized by most C      *
+ *    libraries) and the nodes are constructed directly in the tree          *
  ****************************************************************************/
-static StackTrace::stack_info parseLine( const char *str )
+static inline const char *findChar( const char *p, const char *end, char c )
+{
+    auto ptr = static_cast<const char *>( memchr( p, c, end - p ) );
+    return ptr ? ptr : end;
+}
+static inline const char *findSpaces( const char *p, const char *end )
+{
+    for ( p = findChar( p, end, ' ' ); p + 1 < end; p = findChar( p + 1, end, ' ' ) ) {
+        if ( p[1] == ' ' )
+            return p;
+    }
+    return nullptr;
+}
+static inline const char *skipSpaces( const char *p, const char *end )
+{
+    while ( p < end && *p == ' ' )
+        p++;
+    return p;
+}
+template<class TYPE>
+static inline TYPE readInt( const char *p, const char *end, int base = 10 )
+{
+    TYPE x = 0;
+    std::from_chars( skipSpaces( p, end ), end, x, base );
+    return x;
+}
+static void parseLine( const char *str, const char *p0, StackTrace::stack_info &stack )
 {
-    char tmp[1000];
-    StackTrace::stack_info stack;
     // Load the address
-    const char *p0 = strchr( str, 0 );
-    const char *p1 = strchr( str, 'x' );
-    const char *p2 = strchr( str, ':' );
-    memset( tmp, 0, sizeof( tmp ) );
-    memcpy( tmp, p1 + 1, p2 - p1 - 1 );
-    uint64_t address = strtol( tmp, nullptr, 16 );
-    stack.address    = reinterpret_cast<void *>( address );
-    stack.address2   = stack.address;
+    const char *p1 = findChar( str, p0, 'x' );
+    const char *p2 = findChar( str, p0, ':' );
+    auto address   = readInt<uint64_t>( std::min( p1 + 1, p2 ), p2, 16 );
+    stack.address  = reinterpret_cast<void *>( address );
+    stack.address2 = stack.address;
     // Load object, function, file
-    const char *p3 = p2 + 1;
-    while ( *p3 == ' ' )
-        p3++;
-    if ( *p3 == 0 )
-        return stack;
-    const char *p4 = strstr( p3, "  " );
+    const char *p3 = skipSpaces( std::min( p2 + 1, p0 ), p0 );
+    if ( p3 == p0 )
+        return;
+    const char *p4 = findSpaces( p3, p0 );
     const char *p5 = nullptr;
     if ( p4 != nullptr ) {
-        while ( *p4 == ' ' )
-            p4++;
-        p5 = strstr( p4, "  " );
-        if ( p5 != nullptr ) {
-            while ( *p5 == ' ' )
-                p5++;
-        }
+        p4 = skipSpaces( p4, p0 );
+        p5 = findSpaces( p4, p0 );
+        if ( p5 != nullptr )
+            p5 = skipSpaces( p5, p0 );
     }
     if ( p5 == nullptr ) {
         if ( p3 - p2 > 20 ) {
@@ -2139,72 +3379,121 @@ static StackTrace::stack_info parseLine( const char *str )
     if ( p5 == nullptr )
         p5 = p0;
     // Load line
-    const char *p6 = strchr( p5, ':' );
-    if ( p6 == nullptr )
-        p6 = p0;
+    const char *p6 = findChar( p5, p0, ':' );
     // Store the results
     auto copyField = []( const char *p1, const char *p2, auto &field ) {
-        field.fill( 0 );
-        memcpy( field.data(), p1, std::min<int>( p2 - p1, field.size() ) );
-        for ( int i = field.size() - 1; i > 0 && ( field[i] == ' ' || field[i] == 0 ); i-- )
-            field[i] = 0;
+        while ( p2 > p1 + 1 && p2[-1] == ' ' )
+            p2--;
+        size_t N = std::min<size_t>( p2 - p1, field.size() - 1 );
+        memcpy( field.data(), p1, N );
+        memset( &field[N], 0, field.size() - N );
     };
     copyField( p3, p4, stack.object );
     copyField( p4, p5, stack.function );
     copyField( p5, p6, stack.filename );
     if ( p6 != p0 )
-        stack.line = atoi( p6 + 1 );
-    return stack;
+        stack.line = readInt<int>( p6 + 1, p0 );
+}
+namespace {
+class stackParser final
+{
+public:
+    stackParser() { d_map.emplace_back( 0, &d_stack.children ); }
+    // Parse a single line (without the line break)
+    void addLine( const char *begin, const char *end )
+    {
+        if ( end > begin && end[-1] == '\r' )
+            end--;
+        const char *p1 = findChar( begin, end, '[' );
+        const char *p2 = findChar( begin, end, ']' );
+        const char *p3 = findChar( begin, end, 'x' );
+        if ( p3 == end || p3 == begin )
+            return;
+        int64_t N = 1;
+        if ( p1 < p2 && p1 < p3 )
+            N = readInt<int64_t>( p1 + 1, p2 );
+        size_t indent = std::min( p1, p3 - 1 ) - begin;
+        // Find the parent
+        while ( d_map.size() > 1 && indent < d_map.back().first )
+            d_map.pop_back();
+        auto *children = d_map.back().second;
+        if ( children->empty() )
+            d_map.back().first = indent;
+        if ( indent > d_map.back().first ) {
+            children = &children->back().children;
+            d_map.emplace_back( indent, children );
+        }
+        children->emplace_back();
+        children->back().N = N;
+        parseLine( p3 - 1, end, children->back().stack );
+    }
+    // Parse a block of text
+    void add( const char *begin, const char *end )
+    {
+        while ( begin < end ) {
+            const char *p = findChar( begin, end, '\n' );
+            addLine( begin, p );
+            begin = p + 1;
+        }
+    }
+    StackTrace::multi_stack_info get() { return std::move( d_stack ); }
+
+private:
+    StackTrace::multi_stack_info d_stack;
+    std::vector<std::pair<size_t, std::vector<StackTrace::multi_stack_info> *>> d_map;
+};
+} // namespace
+StackTrace::multi_stack_info StackTrace::generateFromBuffer( const char *data, size_t N )
+{
+    stackParser parser;
+    parser.add( data, data + N );
+    return parser.get();
 }
 StackTrace::multi_stack_info StackTrace::generateFromString( const std::string &str )
 {
-    // Break the string according to line breaks
-    std::vector<std::string> data;
-    size_t p1 = 0;
-    size_t p2 = str.find( '\n' );
-    while ( p2 != std::string::npos ) {
-        data.push_back( str.substr( p1, p2 - p1 ) );
-        p1 = p2 + 1;
-        p2 = str.find( '\n', p1 );
-    }
-    data.push_back( str.substr( p1 ) );
-    // Generate the stack
-    return generateFromString( data );
+    return generateFromBuffer( str.data(), str.size() );
 }
 StackTrace::multi_stack_info StackTrace::generateFromString( const std::vector<std::string> &text )
 {
-    // Get the data from the text
-    std::vector<int> indent;
-    std::vector<multi_stack_info> stack;
-    for ( const auto &str : text ) {
-        auto p1 = str.find( '[' );
-        auto p2 = str.find( ']' );
-        auto p3 = str.find( 'x' );
-        if ( p3 == std::string::npos )
-            continue;
-        multi_stack_info tmp;
-        tmp.N = 1;
-        if ( p1 < p2 && p1 < p3 )
-            tmp.N = std::stoi( str.substr( p1 + 1, p2 - p1 - 1 ) );
-        tmp.stack = parseLine( &str[p3 - 1] );
-        indent.push_back( std::min( p1, p3 - 1 ) );
-        stack.push_back( tmp );
-    }
-    // Generate the stack hierarchy
-    multi_stack_info stack2;
-    std::vector<std::pair<int, std::vector<multi_stack_info> *>> map;
-    map.emplace_back( 0, &stack2.children );
-    for ( size_t i = 0; i < stack.size(); i++ ) {
-        while ( indent[i] < map.back().first )
-            map.resize( map.size() - 1 );
-        if ( indent[i] == map.back().first ) {
-            map.back().second->push_back( stack[i] );
-        } else {
-            map.back().second->back().children.push_back( stack[i] );
-            map.emplace_back( indent[i], &map.back().second->back().children );
-        }
+    stackParser parser;
+    for ( const auto &str : text )
+        parser.addLine( str.data(), str.data() + str.size() );
+    return parser.get();
+}
+StackTrace::multi_stack_info StackTrace::generateFromFile( const std::string &filename )
+{
+#ifdef USE_WINDOWS
+    std::ifstream fid( filename, std::ios::binary );
+    if ( !fid )
+        throw std::runtime_error( "Unable to open file " + filename );
+    std::string str( ( std::istreambuf_iterator<char>( fid ) ), std::istreambuf_iterator<char>() );
+    return generateFromString( str );
+#else
+    // Map the file and parse it in place
+    int fd = open( filename.data(), O_RDONLY );
+    if ( fd < 0 )
+        throw std::runtime_error( "Unable to open file " + filename );
+    struct stat info;
+    size_t size = fstat( fd, &info ) == 0 ? info.st_size : 0;
+    if ( size == 0 ) {
+        close( fd );
+        return multi_stack_info();
+    }
+    void *data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( data == MAP_FAILED )
+        throw std::runtime_error( "Unable to map file " + filename );
+    madvise( data, size, MADV_SEQUENTIAL );
+    stackParser parser;
+    try {
+        parser.add( static_cast<const char *>( data ), static_cast<const char *>( data ) + size );
+    } catch ( ... ) {
+        munmap( data, size );
+        throw;
     }
-    return stack2;
+    munmap( data, size );
+    return parser.get();
+#endif
 }
 
 
@@ -2260,7 +3549,7 @@ const char *StackTrace::abort_error::what() const noexcept
             auto threads = StackTrace::registeredThreads();
             erase( threads, thisThread() );
             for ( auto tid : threads )
-                trace.push_back( backtrace( tid ) );
+                trace.push_back( backtrace( tid, getDefaultStackDepth() ) );
             // Generate call stack
             auto multistack = generateMultiStack( trace );
             // Add remote call stack info
@@ -2285,5 +3574,14 @@ const char *StackTrace::abort_error::what() const noexcept
  * Get/Set default stack type                                                *
  ****************************************************************************/
 static StackTrace::printStackType abort_stackType = StackTrace::printStackType::global;
+static int abort_stackDepth                        = 1000;
+static int abort_stackSkip                         = 0;
 void StackTrace::setDefaultStackType( StackTrace::printStackType type ) { abort_stackType = type; }
 StackTrace::printStackType StackTrace::getDefaultStackType() { return abort_stackType; }
+void StackTrace::setDefaultStackDepth( int maxDepth, int skip )
+{
+    abort_stackDepth = maxDepth;
+    abort_stackSkip  = skip;
+}
+int StackTrace::getDefaultStackDepth() { return abort_stackDepth; }
+int StackTrace::getDefaultStackSkip() { return abort_stackSkip; }
@@ -4,7 +4,9 @@
 #include <array>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <set>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -52,7 +54,7 @@ struct stack_info {
 
 //! Class to contain stack trace info for multiple threads/processes
 struct multi_stack_info {
-    int N = 0;                              // Number of threads/processes
+    int64_t N = 0;                          // Number of threads/processes (or weight)
     stack_info stack;                       // Current stack item
     std::vector<multi_stack_info> children; // Children
     //! Default constructor
@@ -65,29 +67,297 @@ struct multi_stack_info {
     void clear();
     //! Is the stack empty
     bool empty() const { return N == 0; }
-    //! Add the given stack to the multistack
-    void add( size_t len, const stack_info *stack );
+    //! Add the given stack to the multistack (count is the number of times it occurs)
+    void add( size_t len, const stack_info *stack, int64_t count = 1 );
     //! Add the given stack to the multistack
     void add( const multi_stack_info &stack );
+    //! Add the given stack to the multistack (moving the data, stack is cleared)
+    void add( multi_stack_info &&stack );
+    //! Add a child (merged with the matching child if there is one)
+    void addChild( multi_stack_info &&child );
+    /*!
+     * @brief  Invalidate the index of the children
+     * @details  Wide nodes keep a hash index of the children.  The index is rebuilt when
+     *    the children are reallocated or resized, or when a lookup finds an entry whose
+     *    child no longer has the frame it was indexed with (e.g. the children were
+     *    reordered or swapped in place).  This function is only needed after the frame of
+     *    a child is changed in place to a frame that is not in the index.
+     */
+    void invalidateIndex() { d_index = childIndex(); }
+    //! Number of nodes in the tree (including this node)
+    size_t numberOfNodes() const;
+    /*!
+     * @brief  Limit the size of the stack
+     * @details  This function bounds the memory used by the stack.  The paths are
+     *    truncated after maxDepth frames, and if the tree has more than maxNodes nodes
+     *    the children with the lowest counts are removed (the largest count threshold
+     *    that fits is found with a binary search).  The removed children of each node
+     *    are replaced by a single child for otherFrame() that contains their counts,
+     *    so the counts of the remaining nodes are unchanged.
+     * @param[in] maxNodes  Maximum number of nodes
+     * @param[in] maxDepth  Maximum number of frames in a path (excluding otherFrame())
+     */
+    void prune( size_t maxNodes, int maxDepth = std::numeric_limits<int>::max() );
+    //! Memory used by the tree (the nodes, the arrays of children and their indices)
+    size_t memoryUsage() const;
+    //! Frame used for the removed children ("[other]")
+    static const stack_info &otherFrame();
     //! Compute the number of bytes needed to store the object
     size_t size() const;
-    //! Pack the data to a byte array, returning a pointer to the end of the data
+    /*!
+     * @brief  Pack the data to a byte array
+     * @details  This function packs the data using the legacy format, which stores the
+     *    counts as int.  Larger counts (e.g. byte weights) throw std::logic_error and
+     *    must be packed with packCompact().
+     * @param[in] ptr       Pointer to the buffer (at least size() bytes)
+     * @return              Returns a pointer to the end of the data
+     */
     char *pack( char *ptr ) const;
-    //! Unpack the data from a byte array, returning a pointer to the end of the data
+    /*!
+     * @brief  Pack the data using the compact format
+     * @details  This function packs the data using a versioned format with a string
+     *    table, varint encoded counts, delta encoded addresses and a checksum.
+     *    It is typically an order of magnitude smaller than pack(char*).
+     *    unpack(const char*,size_t) detects the format automatically.
+     * @return              Returns the packed data
+     */
+    std::vector<char> packCompact() const;
+    //! Unpack the data written by pack, returning a pointer to the end of the data
     const char *unpack( const char *ptr );
+    /*!
+     * @brief  Unpack the data
+     * @details  This function unpacks the data written by pack or packCompact (the format
+     *    is detected automatically).  It throws std::logic_error if the data is corrupt
+     *    or does not fit in the buffer.
+     * @param[in] ptr       Packed data
+     * @param[in] N         Size of the buffer in bytes
+     * @return              Returns a pointer to the end of the data
+     */
+    const char *unpack( const char *ptr, size_t N );
     //! Print the stack info
     std::vector<std::string> print( const std::string &prefix = "" ) const;
     //! Print the stack info
     void print( std::ostream &out, const std::string &prefix = "" ) const;
+    //! Print the stack info to a file descriptor
+    void print( int fd, const std::string &prefix = "" ) const;
     //! Print the stack info
     std::string printString( const std::string &prefix = "" ) const;
+    //! Append the printed stack info to a string
+    void appendString( std::string &out, const std::string &prefix = "" ) const;
+    //! Print the stack in the folded format ("root;...;leaf count" for each leaf)
+    void printFolded( std::ostream &out ) const;
+    /*!
+     * @brief  Print the stack as a flame graph
+     * @details  This function writes a self-contained svg flame graph of the stack.
+     *    The width of each frame is proportional to the count (N).
+     * @param[out] out      Output stream
+     * @param[in] title     Title of the graph
+     * @param[in] width     Width of the graph in pixels
+     */
+    void printFlameGraph( std::ostream &out, const std::string &title = "Flame Graph",
+                          int width = 1200 ) const;
+    /*!
+     * @brief  Write the stack as a pprof profile
+     * @details  This function writes the stack in the gzip compressed profile.proto
+     *    format used by pprof.  Each frame with a self count creates a sample.
+     * @param[out] out      Output stream (should be opened in binary mode)
+     * @param[in] type      Name of the sample type
+     * @param[in] unit      Unit of the sample type
+     * @param[in] period    Sampling period (in units of the sample type)
+     */
+    void writePprof( std::ostream &out, const char *type = "samples", const char *unit = "count",
+                     int64_t period = 1 ) const;
 
 private:
     template<class FUN>
-    void print2( int Np, char *prefix, int w[3], bool c, FUN &fun ) const;
-    int getAddressWidth() const;
-    int getObjectWidth() const;
-    int getFunctionWidth() const;
+    void print2( const std::string &prefix, FUN &fun ) const;
+    size_t findChild( const stack_info &stack );
+    void buildIndex();
+    void indexChild( size_t i );
+    size_t getChild( const stack_info &stack );
+    void pruneChildren( int64_t threshold, int depth );
+    void pruneToSize( size_t maxNodes, size_t maxBytes, int maxDepth );
+    void getPrunedSize( int64_t threshold, size_t &nodes, size_t &bytes ) const;
+    size_t getLocalMemory() const;
+    // Open-addressing hash index of the children (only used for wide nodes)
+    // Note: the index is not copied and is rebuilt if the children are reallocated or
+    //   resized, or if the child of an entry no longer has the hash of the entry
+    struct childIndex {
+        struct slot {
+            uint32_t child; // Index of the child + 1 (0 if the slot is empty)
+            uint32_t hash;  // Hash of the key the child was indexed with
+        };
+        std::vector<slot> table;
+        const multi_stack_info *data = nullptr;
+        size_t count                 = 0;
+        childIndex()                 = default;
+        childIndex( const childIndex & ) {}
+        childIndex( childIndex && ) = default;
+        childIndex &operator=( const childIndex & )
+        {
+            *this = childIndex();
+            return *this;
+        }
+        childIndex &operator=( childIndex && ) = default;
+    };
+    childIndex d_index;
+    friend class packed_stack_view;
+    friend class bounded_stack_info;
+};
+
+
+//! Class to contain the difference between two multi_stack_info
+struct multi_stack_diff {
+    int64_t N1 = 0;                         // Count in the first stack
+    int64_t N2 = 0;                         // Count in the second stack
+    stack_info stack;                       // Current stack item
+    std::vector<multi_stack_diff> children; // Children
+    //! Change in the count
+    int64_t delta() const { return N2 - N1; }
+    //! Print the difference (new paths are marked with +, vanished paths with -)
+    void print( std::ostream &out, const std::string &prefix = "" ) const;
+    //! Print the difference in the folded format ("root;...;leaf countA countB")
+    void printFolded( std::ostream &out ) const;
+};
+
+
+//! Class to contain the counts for a function or object
+struct hotspot_info {
+    stack_info frame;  //!< First frame for the function (only the object for objects)
+    int64_t self  = 0; //!< Count in the function/object itself
+    int64_t total = 0; //!< Count including the callees (recursive calls are counted once)
+};
+
+
+//! Class to contain the counts for all functions and objects
+struct hotspot_summary {
+    int64_t total = 0;                   //!< Total count
+    std::vector<hotspot_info> functions; //!< Functions (sorted by the self count)
+    std::vector<hotspot_info> objects;   //!< Objects (sorted by the self count)
+};
+
+
+//! Class to contain a call path
+struct path_info {
+    int64_t N = 0;                 //!< Self count of the last frame in the path
+    std::vector<stack_info> stack; //!< Call stack (stack[0] is the leaf)
+};
+
+
+/*!
+ * @brief  Read-only view of a packed multi_stack_info
+ * @details  This class reads the data written by multi_stack_info::packCompact in
+ *    place.  The string table and the frames are indexed when the view is created
+ *    (the strings point into the packed data), but the tree is only walked when it
+ *    is used, so a received buffer can be printed or merged into another stack
+ *    without creating a temporary multi_stack_info.
+ *    The packed data must remain valid while the view is used.
+ */
+class packed_stack_view final
+{
+public:
+    //! Frame in the packed data
+    struct frame {
+        void *address;
+        void *address2;
+        uint32_t line;
+        std::string_view object;
+        std::string_view objectPath;
+        std::string_view filename;
+        std::string_view filenamePath;
+        std::string_view function;
+        //! Convert the frame to a stack_info
+        stack_info toStackInfo() const;
+    };
+
+public:
+    /*!
+     * @brief  Create the view
+     * @details  This function throws std::logic_error if the data is not in the compact
+     *    format, is corrupt, or does not fit in the buffer.
+     * @param[in] data      Packed data
+     * @param[in] N         Size of the buffer in bytes (the data may be followed by more data)
+     */
+    packed_stack_view( const char *data, size_t N );
+    //! Number of bytes of packed data
+    size_t size() const { return d_end - d_data; }
+    //! Count for the root
+    int64_t N() const;
+    //! Number of unique frames
+    size_t numberOfFrames() const { return d_frames.size(); }
+    //! Get a frame
+    const frame &getFrame( size_t id ) const { return d_frames[id]; }
+    /*!
+     * @brief  Visit the nodes
+     * @details  This function calls fun(depth, N, frame) for each node in pre-order.
+     *    The frame is null for nodes without a frame (e.g. the root).
+     * @param[in] fun       Function to call for each node
+     */
+    void visit( const std::function<void( int, int64_t, const frame * )> &fun ) const;
+    //! Print the stack (same as multi_stack_info::print)
+    void print( std::ostream &out, const std::string &prefix = "" ) const;
+    //! Print the stack (same as multi_stack_info::printString)
+    std::string printString( const std::string &prefix = "" ) const;
+    //! Add the stack to another stack (same as stack.add( unpack() ))
+    void addTo( multi_stack_info &stack ) const;
+    //! Convert to a multi_stack_info
+    multi_stack_info unpack() const;
+
+private:
+    void addChildren( const char *&ptr, uint64_t Nc, multi_stack_info &stack,
+                      std::vector<stack_info> &cache ) const;
+    const char *d_data;
+    const char *d_tree;
+    const char *d_end;
+    std::vector<frame> d_frames;
+};
+
+
+/*!
+ * @brief  Memory-bounded multi_stack_info
+ * @details  This class aggregates call stacks in bounded memory for continuous
+ *    profiling.  Paths are truncated after maxDepth frames and the tree is pruned
+ *    (see multi_stack_info::prune) when it exceeds the node or memory budget.  The
+ *    memory includes the arrays of children and their indices, and the growth of
+ *    each array is tracked as the stacks are added.  The tree is pruned to 3/4 of
+ *    the budgets so the cost of pruning is amortized.
+ */
+class bounded_stack_info final
+{
+public:
+    /*!
+     * @brief  Create the stack
+     * @param[in] maxNodes  Maximum number of nodes
+     * @param[in] maxBytes  Maximum memory (see multi_stack_info::memoryUsage)
+     * @param[in] maxDepth  Maximum number of frames in a path
+     */
+    explicit bounded_stack_info( size_t maxNodes, size_t maxBytes = ~( (size_t) 0 ),
+                                 int maxDepth = std::numeric_limits<int>::max() );
+    //! Add the given stack (stack[0] is the leaf, the count is added to the root)
+    void add( size_t len, const stack_info *stack, int64_t count = 1 );
+    //! Add a multi-stack
+    void add( const multi_stack_info &stack );
+    //! Number of nodes
+    size_t numberOfNodes() const { return d_nodes; }
+    //! Maximum number of nodes
+    size_t maxNodes() const { return d_maxNodes; }
+    //! Memory used by the stack (bytes)
+    size_t memoryUsage() const { return d_bytes; }
+    //! Maximum memory (bytes)
+    size_t maxBytes() const { return d_maxBytes; }
+    //! Get the stack
+    const multi_stack_info &get() const { return d_stack; }
+    //! Reset the stack
+    void clear();
+
+private:
+    void prune();
+    multi_stack_info d_stack;
+    size_t d_nodes;
+    size_t d_bytes;
+    size_t d_maxNodes;
+    size_t d_maxBytes;
+    int d_maxDepth;
 };
 
 
@@ -143,14 +413,30 @@ std::vector<stack_info> getCallStack();
 std::vector<stack_info> getCallStack( std::thread::native_handle_type id );
 
 
+/*!
+ * @brief  Get the current call stack for a thread
+ * @details  This function returns the current call stack for the given thread.
+ *    The limits are enforced while unwinding the stack, so the cost of
+ *    getting (and decoding) the stack is bounded for deep stacks.
+ * @param[in] id        The thread id of the stack we want to return
+ * @param[in] maxDepth  The maximum number of frames to return
+ * @param[in] skip      The number of frames to skip at the top of the stack
+ * @return              Returns vector containing the stack
+ */
+std::vector<stack_info> getCallStack( std::thread::native_handle_type id, int maxDepth,
+                                      int skip = 0 );
+
+
 /*!
  * @brief  Get the current call stack for all threads
  * @details  This function returns the current call stack for all threads
  *    in the current process.
  *    Note: This functionality may not be available on all platforms
- * @return          Returns vector containing the stack
+ * @param[in] maxDepth  The maximum number of frames to return for each thread
+ * @param[in] skip      The number of frames to skip at the top of each stack
+ * @return              Returns vector containing the stack
  */
-multi_stack_info getAllCallStacks();
+multi_stack_info getAllCallStacks( int maxDepth = 1000, int skip = 0 );
 
 
 /*!
@@ -165,6 +451,110 @@ multi_stack_info getAllCallStacks();
 multi_stack_info getGlobalCallStacks();
 
 
+/*!
+ * @brief  Get the current call stack for all threads of another process
+ * @details  This function attaches to the given process, stops it, unwinds
+ *    every thread from outside the process and then detaches.  The target
+ *    process does not need to use StackTrace or register its threads.
+ *    Threads are unwound by following the frame pointers.  If the chain of
+ *    frame pointers breaks, the rest of the stack is scanned for return
+ *    addresses; these frames may include stale return addresses and are
+ *    placed below a "[stack scan]" frame.
+ *    Note: This functionality is currently only availible on Linux and
+ *    requires permission to trace the process (ptrace)
+ * @param[in] pid   The process id
+ * @return          Returns the call stack for all threads in the process
+ */
+multi_stack_info getProcessCallStacks( int pid );
+
+
+/*!
+ * @brief  Merge call stacks in parallel
+ * @details  This function builds partial trees for contiguous blocks of the stacks
+ *    on worker threads and merges them pairwise.  The result is identical to adding
+ *    the stacks one at a time (including the order of the children).
+ *    The count of the root (N) is the number of stacks.
+ * @param[in] stacks    The call stacks to merge (stacks[i][0] is the leaf)
+ * @param[in] threads   The number of threads to use (0: use the hardware concurrency)
+ * @return              Returns the merged stack
+ */
+multi_stack_info mergeStacks( const std::vector<std::vector<stack_info>> &stacks,
+                              int threads = 0 );
+
+
+/*!
+ * @brief  Merge stacks in parallel
+ * @details  This function merges the stacks pairwise on worker threads.  The result
+ *    is identical to adding the stacks one at a time to an empty stack, so the root
+ *    frame of the result is empty (the frames of the roots are not merged).
+ * @param[in] stacks    The stacks to merge
+ * @param[in] threads   The number of threads to use (0: use the hardware concurrency)
+ * @return              Returns the merged stack
+ */
+multi_stack_info mergeStacks( std::vector<multi_stack_info> stacks, int threads = 0 );
+
+
+/*!
+ * @brief  Merge packed stacks in parallel
+ * @details  This function merges the stacks directly from the packed data on
+ *    worker threads (the stacks are not unpacked).  The result is identical to
+ *    adding the unpacked stacks one at a time.  Small inputs (by the total size of
+ *    the packed data) are merged on fewer threads.
+ * @param[in] stacks    The stacks to merge
+ * @param[in] threads   The number of threads to use (0: use the hardware concurrency)
+ * @return              Returns the merged stack
+ */
+multi_stack_info mergeStacks( const std::vector<packed_stack_view> &stacks, int threads = 0 );
+
+
+/*!
+ * @brief  Compute the difference between two stacks
+ * @details  This function matches the frames of the two stacks (by object and
+ *    offset, or address) and returns a tree containing the counts from both.
+ *    Paths that only exist in one of the stacks have a count of zero in the other.
+ *    The cost is linear in the size of the stacks.
+ * @param[in] a     The first (reference) stack
+ * @param[in] b     The second stack
+ * @return          Returns the difference
+ */
+multi_stack_diff diff( const multi_stack_info &a, const multi_stack_info &b );
+
+
+/*!
+ * @brief  Get the hot functions and objects
+ * @details  This function computes the self and inclusive (total) counts for each
+ *    function and object in a single traversal of the stack.  Functions are
+ *    identified by the object and function name (or the offset if there is no name),
+ *    so the frames for different lines of a function are combined.  Recursive calls
+ *    only contribute once to the total.
+ * @param[in] stack     The stack to analyze
+ * @return              Returns the counts sorted by the self count
+ */
+hotspot_summary getHotspots( const multi_stack_info &stack );
+
+
+/*!
+ * @brief  Get the hot call paths
+ * @details  This function returns the N call paths with the highest self count.
+ * @param[in] stack     The stack to analyze
+ * @param[in] N         The number of paths to return
+ * @return              Returns the paths sorted by the count
+ */
+std::vector<path_info> getHotPaths( const multi_stack_info &stack, size_t N = 10 );
+
+
+/*!
+ * @brief  Collapse the stack by function
+ * @details  This function combines the frames for the same function (e.g. different
+ *    lines) and merges recursive calls (direct or indirect) into the first call of
+ *    the function on the path, e.g. A->B->A->C becomes A->B->C.
+ *    The frame for each function is the first frame found with the line removed.
+ * @param[in] stack     The stack to collapse
+ * @return              Returns the collapsed stack
+ */
+multi_stack_info collapseByFunction( const multi_stack_info &stack );
+
+
 /*!
  * @brief  Clean up the stack trace
  * @details  This function modifies the stack trace to remove entries
@@ -181,8 +571,38 @@ std::vector<void *> backtrace();
 //! Function to return the current call stack for the given thread
 std::vector<void *> backtrace( std::thread::native_handle_type id );
 
-//! Function to return the current call stack for all registered threads
-std::vector<std::vector<void *>> backtraceAll();
+/*!
+ * @brief  Function to return the current call stack for the given thread
+ * @param[in] id        The thread id of the stack we want to return
+ * @param[in] maxDepth  The maximum number of frames to return
+ * @param[in] skip      The number of frames to skip at the top of the stack
+ * @return              Returns the addresses in the call stack
+ */
+std::vector<void *> backtrace( std::thread::native_handle_type id, int maxDepth, int skip = 0 );
+
+/*!
+ * @brief  Function to return the current call stack for all registered threads
+ * @param[in] maxDepth  The maximum number of frames to return for each thread
+ * @param[in] skip      The number of frames to skip at the top of each stack
+ * @return              Returns the addresses in the call stack for each thread
+ */
+std::vector<std::vector<void *>> backtraceAll( int maxDepth = 1000, int skip = 0 );
+
+
+/*!
+ * @brief  Write raw call stacks as a pprof profile
+ * @details  This function writes the call stacks in the gzip compressed profile.proto
+ *    format used by pprof.  The addresses are decoded once for all samples.
+ * @param[out] out      Output stream (should be opened in binary mode)
+ * @param[in] samples   Call stacks (e.g. from backtraceAll), first entry is the leaf
+ * @param[in] weights   Weight of each sample (default is 1)
+ * @param[in] type      Name of the sample type
+ * @param[in] unit      Unit of the sample type
+ * @param[in] period    Sampling period (in units of the sample type)
+ */
+void writePprof( std::ostream &out, const std::vector<std::vector<void *>> &samples,
+                 const std::vector<int64_t> &weights = {}, const char *type = "samples",
+                 const char *unit = "count", int64_t period = 1 );
 
 
 //! Function to return the stack info for a given address
@@ -246,6 +666,26 @@ void clearSignals();
 void raiseSignal( int signal );
 
 
+/*!
+ * @brief  Enable live stack dumps
+ * @details  This function installs a handler so that sending the given signal to
+ *    the process (e.g. kill -USR2 <pid>) appends the cleaned-up call stacks of all
+ *    threads to the file "<path>.<pid>" without stopping the process.  The signal
+ *    handler only notifies a dedicated thread that captures and writes the stacks.
+ *    If a control file is given, the dump is also triggered by creating the file
+ *    (it is removed after the dump, and checked once per second).
+ *    Note: This functionality is not availible on Windows
+ * @param[in] signal        Signal to trigger the dump (0 to only use the control file)
+ * @param[in] path          Base name of the file to write
+ * @param[in] controlFile   Optional file that triggers the dump
+ */
+void enableLiveDump( int signal, const std::string &path, const std::string &controlFile = "" );
+
+
+//! Disable live stack dumps (restores the previous signal handler)
+void disableLiveDump();
+
+
 //! Default function to abort after catching a signal
 void terminateFunctionSignal( int signal );
 
@@ -276,6 +716,41 @@ std::vector<std::thread::native_handle_type> registeredThreads();
 std::vector<std::thread::native_handle_type> activeThreads();
 
 
+//! Record that the current thread is making progress (see startWatchdog)
+void heartbeat();
+
+//! Mark the current thread as idle (it is not monitored until the next heartbeat)
+void heartbeatIdle();
+
+/*!
+ * @brief  Start the hang watchdog
+ * @details  This function starts a thread that monitors the threads that call
+ *    heartbeat().  If a thread does not call heartbeat() (or heartbeatIdle())
+ *    for longer than the timeout, the call stacks of all threads are captured
+ *    and appended to the given file.  Each stall is reported once.
+ * @param[in] timeout   The maximum time between heartbeats (seconds)
+ * @param[in] filename  The file to write the call stacks to
+ * @param[in] global    Capture the call stacks for all processes (getGlobalCallStacks)
+ */
+void startWatchdog( double timeout, const std::string &filename, bool global = false );
+
+/*!
+ * @brief  Start the hang watchdog
+ * @details  This function starts a thread that monitors the threads that call
+ *    heartbeat().  If a thread does not call heartbeat() (or heartbeatIdle())
+ *    for longer than the timeout, the call stacks of all threads are captured
+ *    and passed to the callback.  Each stall is reported once.
+ * @param[in] timeout   The maximum time between heartbeats (seconds)
+ * @param[in] callback  Function to call with the call stacks
+ * @param[in] global    Capture the call stacks for all processes (getGlobalCallStacks)
+ */
+void startWatchdog( double timeout, std::function<void( const multi_stack_info & )> callback,
+                    bool global = false );
+
+//! Stop the hang watchdog
+void stopWatchdog();
+
+
 /*!
  * @brief  Create stack from string
  * @details  This function creates the call stack from the string generated by print
@@ -294,12 +769,47 @@ multi_stack_info generateFromString( const std::vector<std::string> &str );
 multi_stack_info generateFromString( const std::string &str );
 
 
+/*!
+ * @brief  Create stack from a buffer
+ * @details  This function creates the call stack from text generated by print.
+ *    The buffer is parsed in place in a single pass (it does not need to be
+ *    null terminated), so it can be used on large memory mapped files.
+ * @param[in] data          Pointer to the text
+ * @param[in] N             Number of characters
+ * @return                  Returns the call stack
+ */
+multi_stack_info generateFromBuffer( const char *data, size_t N );
+
+
+/*!
+ * @brief  Create stack from a file
+ * @details  This function creates the call stack from a file generated by print.
+ *    The file is memory mapped (if supported) and parsed in place.
+ * @param[in] filename      Name of the file
+ * @return                  Returns the call stack
+ */
+multi_stack_info generateFromFile( const std::string &filename );
+
+
 //! Set default stack type
 void setDefaultStackType( StackTrace::printStackType );
 
 //! Get default stack type
 StackTrace::printStackType getDefaultStackType();
 
+/*!
+ * Set the default stack depth used for abort_error
+ * @param[in] maxDepth  The maximum number of frames to capture
+ * @param[in] skip      The number of frames to skip at the top of the stack
+ */
+void setDefaultStackDepth( int maxDepth, int skip = 0 );
+
+//! Get the default maximum stack depth
+int getDefaultStackDepth();
+
+//! Get the default number of frames to skip
+int getDefaultStackSkip();
+
 
 } // namespace StackTrace
 
@@ -0,0 +1,384 @@
+#include "StackTrace/StackTrace.h"
+#include "StackTrace/FlatStack.h"
+#include "StackTrace/Internal.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+using StackTrace::flat_stack_info;
+using StackTrace::hotspot_info;
+using StackTrace::hotspot_summary;
+using StackTrace::multi_stack_diff;
+using StackTrace::multi_stack_info;
+using StackTrace::path_info;
+using StackTrace::stack_info;
+using StackTrace::Internal::getName;
+using StackTrace::Internal::getSelf;
+using StackTrace::Internal::hasFrame;
+
+
+/****************************************************************************
+ *  Key to identify a frame                                                  *
+ *  Note: frames are matched by the object and offset if availible (this     *
+ *    matches stacks from different processes), otherwise by the address     *
+ ****************************************************************************/
+namespace {
+struct frameKey {
+    const void *address;
+    std::string_view object;
+    explicit frameKey( const stack_info &stack )
+        : address( stack.object[0] != 0 ? stack.address2 : stack.address ),
+          object( stack.object.data() )
+    {
+    }
+    bool operator==( const frameKey &rhs ) const
+    {
+        return address == rhs.address && object == rhs.object;
+    }
+};
+struct frameKeyHash {
+    size_t operator()( const frameKey &key ) const
+    {
+        return std::hash<const void *>()( key.address ) ^
+               ( std::hash<std::string_view>()( key.object ) * 0x9E3779B97F4A7C15ull );
+    }
+};
+} // namespace
+
+
+/****************************************************************************
+ *  Key to identify a function                                               *
+ *  Note: functions are matched by the object and name (frames without a     *
+ *    name are matched by the offset)                                        *
+ ****************************************************************************/
+namespace {
+struct functionKey {
+    const void *address;
+    std::string_view object;
+    std::string_view function;
+    explicit functionKey( const stack_info &stack )
+        : address( stack.function[0] != 0 ?
+                       nullptr :
+                       ( stack.object[0] != 0 ? stack.address2 : stack.address ) ),
+          object( stack.object.data() ),
+          function( stack.function.data() )
+    {
+    }
+    bool operator==( const functionKey &rhs ) const
+    {
+        return address == rhs.address && object == rhs.object && function == rhs.function;
+    }
+};
+struct functionKeyHash {
+    size_t operator()( const functionKey &key ) const
+    {
+        std::hash<std::string_view> hash;
+        return std::hash<const void *>()( key.address ) ^
+               ( hash( key.object ) * 0x9E3779B97F4A7C15ull ) ^ hash( key.function );
+    }
+};
+} // namespace
+
+
+/****************************************************************************
+ *  Compute the difference between two stacks                                *
+ ****************************************************************************/
+static void diff2( const multi_stack_info *a, const multi_stack_info *b, multi_stack_diff &result )
+{
+    result.N1    = a ? a->N : 0;
+    result.N2    = b ? b->N : 0;
+    result.stack = a ? a->stack : b->stack;
+    size_t Na    = a ? a->children.size() : 0;
+    size_t Nb    = b ? b->children.size() : 0;
+    result.children.resize( Na );
+    // Index the children of b
+    std::unordered_map<frameKey, size_t, frameKeyHash> index;
+    index.reserve( Nb );
+    for ( size_t i = 0; i < Nb; i++ )
+        index.emplace( frameKey( b->children[i].stack ), i );
+    // Match the children of a
+    std::vector<bool> used( Nb, false );
+    for ( size_t i = 0; i < Na; i++ ) {
+        const multi_stack_info *match = nullptr;
+        auto it = index.find( frameKey( a->children[i].stack ) );
+        if ( it != index.end() && !used[it->second] ) {
+            used[it->second] = true;
+            match            = &b->children[it->second];
+        }
+        diff2( &a->children[i], match, result.children[i] );
+    }
+    // Add the children only in b
+    for ( size_t i = 0; i < Nb; i++ ) {
+        if ( !used[i] ) {
+            result.children.resize( result.children.size() + 1 );
+            diff2( nullptr, &b->children[i], result.children.back() );
+        }
+    }
+}
+multi_stack_diff StackTrace::diff( const multi_stack_info &a, const multi_stack_info &b )
+{
+    multi_stack_diff result;
+    diff2( &a, &b, result );
+    return result;
+}
+
+
+/****************************************************************************
+ *  Print the difference                                                     *
+ ****************************************************************************/
+void multi_stack_diff::print( std::ostream &out, const std::string &prefix ) const
+{
+    // Mark paths that are new (+) or vanished (-)
+    auto count = []( const multi_stack_diff &stack, char *buf, size_t size ) {
+        char type = stack.N1 == 0 ? '+' : ( stack.N2 == 0 ? '-' : ' ' );
+        snprintf( buf, size, "%c[%lli -> %lli (%+lli)] ", type, static_cast<long long>( stack.N1 ),
+                  static_cast<long long>( stack.N2 ), static_cast<long long>( stack.delta() ) );
+    };
+    auto fun     = [&out]( const std::string &line ) { out << line << '\n'; };
+    auto prefix2 = prefix;
+    std::string line;
+    Internal::printTree( *this, prefix2, Internal::getAddressWidth( *this ), false, line, count,
+                         fun );
+    out.flush();
+}
+
+
+/****************************************************************************
+ *  Folded difference: "root;child;leaf countA countB"                       *
+ ****************************************************************************/
+static void printFolded2( const multi_stack_diff &stack, std::string &path, std::ostream &out )
+{
+    size_t length = path.size();
+    if ( !path.empty() )
+        path += ';';
+    char buf[128];
+    auto name = getName( stack.stack, buf, sizeof( buf ) );
+    for ( size_t i = 0; name[i] != 0; i++ )
+        path += name[i] == ';' ? ':' : name[i];
+    int64_t N1 = stack.N1, N2 = stack.N2;
+    for ( const auto &child : stack.children ) {
+        N1 -= child.N1;
+        N2 -= child.N2;
+    }
+    N1 = std::max<int64_t>( N1, 0 );
+    N2 = std::max<int64_t>( N2, 0 );
+    if ( N1 > 0 || N2 > 0 )
+        out << path << ' ' << N1 << ' ' << N2 << '\n';
+    for ( const auto &child : stack.children )
+        printFolded2( child, path, out );
+    path.resize( length );
+}
+void multi_stack_diff::printFolded( std::ostream &out ) const
+{
+    std::string path;
+    path.reserve( 4096 );
+    if ( !hasFrame( stack ) ) {
+        for ( const auto &child : children )
+            printFolded2( child, path, out );
+    } else {
+        printFolded2( *this, path, out );
+    }
+    out.flush();
+}
+
+
+/****************************************************************************
+ *  Hot functions and objects                                                *
+ *  Note: the number of active frames for each function/object on the        *
+ *    current path is tracked so that recursion is only counted once         *
+ ****************************************************************************/
+namespace {
+struct hotspotEntry {
+    const stack_info *frame;
+    int64_t self;
+    int64_t total;
+    int active;
+};
+class hotspotTable final
+{
+public:
+    void add( const multi_stack_info &stack )
+    {
+        // Note: the entries are referenced by index since adding the children may reallocate
+        bool frame = hasFrame( stack.stack );
+        size_t fun = 0, obj = 0;
+        if ( frame ) {
+            fun = get( d_functions, d_functionIndex, functionKey( stack.stack ), stack.stack );
+            obj = get( d_objects, d_objectIndex, std::string_view( stack.stack.object.data() ),
+                       stack.stack );
+            int64_t self = getSelf( stack );
+            for ( auto entry : { &d_functions[fun], &d_objects[obj] } ) {
+                entry->self += self;
+                if ( entry->active++ == 0 )
+                    entry->total += stack.N;
+            }
+        }
+        for ( const auto &child : stack.children )
+            add( child );
+        if ( frame ) {
+            d_functions[fun].active--;
+            d_objects[obj].active--;
+        }
+    }
+    std::vector<hotspot_info> getFunctions() const { return convert( d_functions, false ); }
+    std::vector<hotspot_info> getObjects() const { return convert( d_objects, true ); }
+
+private:
+    template<class KEY, class MAP>
+    static size_t get( std::vector<hotspotEntry> &data, MAP &index, const KEY &key,
+                       const stack_info &frame )
+    {
+        auto it = index.emplace( key, data.size() ).first;
+        if ( it->second == data.size() )
+            data.push_back( { &frame, 0, 0, 0 } );
+        return it->second;
+    }
+    static std::vector<hotspot_info> convert( const std::vector<hotspotEntry> &data,
+                                              bool object )
+    {
+        std::vector<hotspot_info> result( data.size() );
+        for ( size_t i = 0; i < data.size(); i++ ) {
+            result[i].self  = data[i].self;
+            result[i].total = data[i].total;
+            if ( object ) {
+                result[i].frame.object     = data[i].frame->object;
+                result[i].frame.objectPath = data[i].frame->objectPath;
+            } else {
+                result[i].frame = *data[i].frame;
+            }
+        }
+        std::stable_sort( result.begin(), result.end(), []( const auto &a, const auto &b ) {
+            return a.self == b.self ? a.total > b.total : a.self > b.self;
+        } );
+        return result;
+    }
+    std::vector<hotspotEntry> d_functions;
+    std::vector<hotspotEntry> d_objects;
+    std::unordered_map<functionKey, size_t, functionKeyHash> d_functionIndex;
+    std::unordered_map<std::string_view, size_t> d_objectIndex;
+};
+} // namespace
+hotspot_summary StackTrace::getHotspots( const multi_stack_info &stack )
+{
+    hotspotTable table;
+    table.add( stack );
+    hotspot_summary summary;
+    for ( const auto &child : stack.children )
+        summary.total += child.N;
+    summary.total     = std::max( summary.total, stack.N );
+    summary.functions = table.getFunctions();
+    summary.objects   = table.getObjects();
+    return summary;
+}
+
+
+/****************************************************************************
+ *  Hot call paths                                                           *
+ ****************************************************************************/
+using pathEntry = std::pair<int64_t, std::vector<const multi_stack_info *>>;
+struct pathCompare {
+    bool operator()( const pathEntry &a, const pathEntry &b ) const { return a.first > b.first; }
+};
+using pathQueue = std::priority_queue<pathEntry, std::vector<pathEntry>, pathCompare>;
+static void getHotPaths2( const multi_stack_info &stack, size_t N,
+                          std::vector<const multi_stack_info *> &path, pathQueue &queue )
+{
+    bool frame = hasFrame( stack.stack );
+    if ( frame )
+        path.push_back( &stack );
+    int64_t self = getSelf( stack );
+    if ( frame && self > 0 && ( queue.size() < N || self > queue.top().first ) ) {
+        queue.emplace( self, path );
+        if ( queue.size() > N )
+            queue.pop();
+    }
+    for ( const auto &child : stack.children )
+        getHotPaths2( child, N, path, queue );
+    if ( frame )
+        path.pop_back();
+}
+std::vector<path_info> StackTrace::getHotPaths( const multi_stack_info &stack, size_t N )
+{
+    if ( N == 0 )
+        return {};
+    pathQueue queue;
+    std::vector<const multi_stack_info *> path;
+    getHotPaths2( stack, N, path, queue );
+    std::vector<path_info> paths( queue.size() );
+    for ( size_t i = paths.size(); i > 0; i-- ) {
+        const auto &entry = queue.top();
+        paths[i - 1].N    = entry.first;
+        for ( auto it = entry.second.rbegin(); it != entry.second.rend(); ++it )
+            paths[i - 1].stack.push_back( ( *it )->stack );
+        queue.pop();
+    }
+    return paths;
+}
+
+
+/****************************************************************************
+ *  Collapse the stack by function                                           *
+ ****************************************************************************/
+namespace {
+class functionCollapser final
+{
+public:
+    void addNode( const multi_stack_info &stack, uint32_t parent )
+    {
+        uint32_t id = getFrame( stack.stack );
+        if ( d_onPath[id] ) {
+            // Recursive call, direct or indirect (the count is already included in the
+            //   first call of the function on the path)
+            addChildren( stack, parent );
+        } else {
+            uint32_t index = d_flat.getChild( parent, id );
+            d_flat.addCount( index, stack.N );
+            d_onPath[id] = true;
+            addChildren( stack, index );
+            d_onPath[id] = false;
+        }
+    }
+    void addChildren( const multi_stack_info &stack, uint32_t parent )
+    {
+        for ( const auto &child : stack.children )
+            addNode( child, parent );
+    }
+    flat_stack_info &flat() { return d_flat; }
+
+private:
+    uint32_t getFrame( const stack_info &stack )
+    {
+        auto it = d_frames.emplace( functionKey( stack ), 0 ).first;
+        if ( it->second == 0 ) {
+            stack_info frame = stack;
+            frame.line       = 0;
+            it->second       = d_flat.addFrame( frame ) + 1;
+            d_onPath.resize( it->second, false );
+        }
+        return it->second - 1;
+    }
+    flat_stack_info d_flat;
+    std::unordered_map<functionKey, uint32_t, functionKeyHash> d_frames;
+    std::vector<bool> d_onPath; // Is the function on the current path
+};
+} // namespace
+multi_stack_info StackTrace::collapseByFunction( const multi_stack_info &stack )
+{
+    functionCollapser collapser;
+    if ( !hasFrame( stack.stack ) ) {
+        collapser.flat().addCount( 0, stack.N );
+        collapser.addChildren( stack, 0 );
+        return collapser.flat().toMultiStack();
+    }
+    collapser.addNode( stack, 0 );
+    auto result = collapser.flat().toMultiStack();
+    return std::move( result.children[0] );
+}
@@ -0,0 +1,28 @@
+#include "StackTrace/StackTrace.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+
+// Print the call stack for all threads of another process
+int main( int argc, char *argv[] )
+{
+    if ( argc != 2 || atoi( argv[1] ) <= 0 ) {
+        std::cerr << "Usage: stacktrace-dump <pid>\n";
+        return -1;
+    }
+    int pid = atoi( argv[1] );
+
+    // Get the call stack
+    auto stack = StackTrace::getProcessCallStacks( pid );
+    if ( stack.empty() ) {
+        std::cerr << "Unable to get the call stack for process " << pid << std::endl;
+        return -1;
+    }
+
+    // Print the results
+    StackTrace::cleanupStackTrace( stack );
+    stack.print( std::cout );
+    return 0;
+}
@@ -0,0 +1,440 @@
+#include "StackTrace/Internal.h"
+#include "StackTrace/StackTrace.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+
+using StackTrace::multi_stack_info;
+using StackTrace::stack_info;
+using StackTrace::Internal::getName;
+using StackTrace::Internal::getSelf;
+using StackTrace::Internal::hasFrame;
+
+
+/****************************************************************************
+ *  Helper functions                                                         *
+ ****************************************************************************/
+static inline int getDepth( const multi_stack_info &stack )
+{
+    int depth = 0;
+    for ( const auto &child : stack.children )
+        depth = std::max( depth, getDepth( child ) );
+    return depth + 1;
+}
+static inline int64_t getTotal( const multi_stack_info &stack )
+{
+    // Note: the root of a stack may not have the count set (e.g. generateFromString)
+    int64_t N = 0;
+    for ( const auto &child : stack.children )
+        N += child.N;
+    return std::max<int64_t>( N, stack.N );
+}
+
+
+/****************************************************************************
+ *  Folded stacks: "root;child;leaf count"                                   *
+ ****************************************************************************/
+static void printFolded2( const multi_stack_info &stack, std::string &path, std::ostream &out )
+{
+    size_t length = path.size();
+    if ( !path.empty() )
+        path += ';';
+    char buf[128];
+    auto name = getName( stack.stack, buf, sizeof( buf ) );
+    for ( size_t i = 0; name[i] != 0; i++ )
+        path += name[i] == ';' ? ':' : name[i];
+    auto N = getSelf( stack );
+    if ( N > 0 )
+        out << path << ' ' << N << '\n';
+    for ( const auto &child : stack.children )
+        printFolded2( child, path, out );
+    path.resize( length );
+}
+void multi_stack_info::printFolded( std::ostream &out ) const
+{
+    std::string path;
+    path.reserve( 4096 );
+    if ( !hasFrame( stack ) ) {
+        for ( const auto &child : children )
+            printFolded2( child, path, out );
+    } else {
+        printFolded2( *this, path, out );
+    }
+    out.flush();
+}
+
+
+/****************************************************************************
+ *  Flame graph (svg)                                                        *
+ ****************************************************************************/
+static constexpr int frameHeight = 16;
+static constexpr int padTop      = 40;
+static constexpr int padBottom   = 10;
+static constexpr int padSide     = 10;
+static void writeXML( std::ostream &out, const char *str, size_t N = std::string::npos )
+{
+    for ( size_t i = 0; i < N && str[i] != 0; i++ ) {
+        if ( str[i] == '<' )
+            out << "&lt;";
+        else if ( str[i] == '>' )
+            out << "&gt;";
+        else if ( str[i] == '&' )
+            out << "&amp;";
+        else if ( str[i] == '"' )
+            out << "&quot;";
+        else
+            out << str[i];
+    }
+}
+static void writeFrame( std::ostream &out, const char *name, int64_t N, double total, double x,
+                        double y, double width )
+{
+    // Choose a color from the name (consistent between graphs)
+    uint32_t hash = 2166136261u;
+    for ( size_t i = 0; name[i] != 0; i++ )
+        hash = ( hash ^ static_cast<uint8_t>( name[i] ) ) * 16777619u;
+    int r = 205 + hash % 51;
+    int g = ( hash >> 8 ) % 231;
+    int b = ( hash >> 16 ) % 56;
+    // Write the frame
+    char buf[128];
+    out << "<g><title>";
+    writeXML( out, name );
+    snprintf( buf, sizeof( buf ), " (%lli samples, %.2f%%)", (long long) N, 100.0 * N / total );
+    out << buf << "</title>";
+    snprintf( buf, sizeof( buf ),
+              "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%i\" fill=\"rgb(%i,%i,%i)\" "
+              "rx=\"2\" ry=\"2\"/>",
+              x, y, width, frameHeight - 1, r, g, b );
+    out << buf;
+    // Write the label (truncated to fit in the frame)
+    size_t chars = std::max<int>( ( width - 6 ) / 7, 0 );
+    if ( chars >= 3 ) {
+        size_t length = strlen( name );
+        snprintf( buf, sizeof( buf ), "<text x=\"%.1f\" y=\"%.1f\">", x + 3, y + 10.5 );
+        out << buf;
+        if ( length <= chars ) {
+            writeXML( out, name );
+        } else {
+            writeXML( out, name, chars - 2 );
+            out << "..";
+        }
+        out << "</text>";
+    }
+    out << "</g>\n";
+}
+static void printFlameGraph2( const multi_stack_info &stack, std::ostream &out, double total,
+                              double scale, double x, double y )
+{
+    double width = scale * stack.N;
+    if ( width < 0.1 )
+        return;
+    char buf[128];
+    writeFrame( out, getName( stack.stack, buf, sizeof( buf ) ), stack.N, total, x, y, width );
+    for ( const auto &child : stack.children ) {
+        printFlameGraph2( child, out, total, scale, x, y - frameHeight );
+        x += scale * child.N;
+    }
+}
+void multi_stack_info::printFlameGraph( std::ostream &out, const std::string &title,
+                                        int width ) const
+{
+    // Get the size of the graph
+    int height   = padTop + padBottom + getDepth( *this ) * frameHeight;
+    double total = std::max<int64_t>( getTotal( *this ), 1 );
+    double scale = ( width - 2 * padSide ) / total;
+    // Write the header
+    out << "<?xml version=\"1.0\" standalone=\"no\"?>\n";
+    out << "<svg version=\"1.1\" width=\"" << width << "\" height=\"" << height
+        << "\" viewBox=\"0 0 " << width << " " << height
+        << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+    out << "<rect x=\"0\" y=\"0\" width=\"100%\" height=\"100%\" fill=\"rgb(248,248,248)\"/>\n";
+    out << "<text x=\"" << width / 2 << "\" y=\"24\" text-anchor=\"middle\" "
+        << "font-family=\"Verdana\" font-size=\"17\">";
+    writeXML( out, title.data() );
+    out << "</text>\n";
+    out << "<g font-family=\"Verdana\" font-size=\"12\">\n";
+    // Write the frames (the root is drawn at the bottom)
+    double y = height - padBottom - frameHeight;
+    if ( !hasFrame( stack ) ) {
+        writeFrame( out, "all", total, total, padSide, y, scale * total );
+        double x = padSide;
+        for ( const auto &child : children ) {
+            printFlameGraph2( child, out, total, scale, x, y - frameHeight );
+            x += scale * child.N;
+        }
+    } else {
+        printFlameGraph2( *this, out, total, scale, padSide, y );
+    }
+    out << "</g>\n</svg>\n";
+    out.flush();
+}
+
+
+/****************************************************************************
+ *  pprof (profile.proto) writer                                             *
+ ****************************************************************************/
+namespace {
+class protobuf final
+{
+public:
+    std::string data;
+    void varint( uint64_t x )
+    {
+        while ( x >= 0x80 ) {
+            data += static_cast<char>( ( x & 0x7F ) | 0x80 );
+            x >>= 7;
+        }
+        data += static_cast<char>( x );
+    }
+    void tag( int field, int type ) { varint( ( field << 3 ) | type ); }
+    void integer( int field, uint64_t x )
+    {
+        if ( x == 0 )
+            return;
+        tag( field, 0 );
+        varint( x );
+    }
+    void bytes( int field, const char *x, size_t N )
+    {
+        tag( field, 2 );
+        varint( N );
+        data.append( x, N );
+    }
+    void message( int field, const protobuf &x ) { bytes( field, x.data.data(), x.data.size() ); }
+    template<class TYPE>
+    void packed( int field, const std::vector<TYPE> &x )
+    {
+        protobuf tmp;
+        for ( auto y : x )
+            tmp.varint( y );
+        message( field, tmp );
+    }
+};
+class pprofWriter final
+{
+public:
+    pprofWriter( const char *type, const char *unit )
+    {
+        string( "" );
+        protobuf sampleType;
+        sampleType.integer( 1, string( type ) );
+        sampleType.integer( 2, string( unit ) );
+        d_profile.message( 1, sampleType );
+        d_profile.message( 11, sampleType ); // period_type
+    }
+    // Add a sample (the first location is the leaf)
+    void addSample( const std::vector<uint64_t> &locations, int64_t value )
+    {
+        protobuf sample;
+        sample.packed( 1, locations );
+        sample.packed( 2, std::vector<uint64_t>( 1, value ) );
+        d_profile.message( 2, sample );
+    }
+    // Get the location for a frame
+    uint64_t location( const stack_info &stack )
+    {
+        auto key = std::make_tuple( reinterpret_cast<size_t>( stack.address2 ),
+                                    std::string( stack.object.data() ),
+                                    reinterpret_cast<size_t>( stack.address ) );
+        if ( stack.object[0] != 0 )
+            std::get<2>( key ) = 0;
+        auto it = d_locations.find( key );
+        if ( it != d_locations.end() )
+            return it->second;
+        uint64_t id = d_locations.size() + 1;
+        d_locations.emplace( key, id );
+        protobuf location;
+        location.integer( 1, id );
+        location.integer( 2, mapping( stack ) );
+        location.integer( 3, reinterpret_cast<size_t>( stack.address ) );
+        if ( stack.function[0] != 0 ) {
+            protobuf line;
+            line.integer( 1, function( stack ) );
+            line.integer( 2, stack.line );
+            location.message( 4, line );
+        }
+        d_profile.message( 4, location );
+        return id;
+    }
+    // Finish the profile and return the serialized data
+    std::string finalize( int64_t period )
+    {
+        d_profile.integer( 12, period );
+        for ( const auto &str : d_strings )
+            d_profile.bytes( 6, str.data(), str.size() );
+        return std::move( d_profile.data );
+    }
+
+private:
+    uint64_t string( const std::string &str )
+    {
+        auto it = d_stringIndex.find( str );
+        if ( it != d_stringIndex.end() )
+            return it->second;
+        d_stringIndex.emplace( str, d_strings.size() );
+        d_strings.push_back( str );
+        return d_strings.size() - 1;
+    }
+    uint64_t mapping( const stack_info &stack )
+    {
+        if ( stack.object[0] == 0 )
+            return 0;
+        std::string path = stack.objectPath.data();
+        path += stack.object.data();
+        auto it = d_mappings.find( path );
+        if ( it != d_mappings.end() )
+            return it->second;
+        uint64_t id = d_mappings.size() + 1;
+        d_mappings.emplace( path, id );
+        auto base = reinterpret_cast<size_t>( stack.address ) -
+                    reinterpret_cast<size_t>( stack.address2 );
+        protobuf mapping;
+        mapping.integer( 1, id );
+        mapping.integer( 2, stack.address2 ? base : 0 );
+        mapping.integer( 5, string( path ) );
+        mapping.integer( 7, 1 ); // has_functions
+        mapping.integer( 8, 1 ); // has_filenames
+        mapping.integer( 9, 1 ); // has_line_numbers
+        d_profile.message( 3, mapping );
+        return id;
+    }
+    uint64_t function( const stack_info &stack )
+    {
+        std::string filename = stack.filenamePath.data();
+        filename += stack.filename.data();
+        auto key = std::make_pair( std::string( stack.function.data() ), filename );
+        auto it  = d_functions.find( key );
+        if ( it != d_functions.end() )
+            return it->second;
+        uint64_t id = d_functions.size() + 1;
+        d_functions.emplace( key, id );
+        protobuf function;
+        function.integer( 1, id );
+        function.integer( 2, string( key.first ) );
+        function.integer( 3, string( key.first ) );
+        function.integer( 4, string( key.second ) );
+        d_profile.message( 5, function );
+        return id;
+    }
+
+private:
+    protobuf d_profile;
+    std::vector<std::string> d_strings;
+    std::unordered_map<std::string, uint64_t> d_stringIndex;
+    std::map<std::tuple<size_t, std::string, size_t>, uint64_t> d_locations;
+    std::map<std::string, uint64_t> d_mappings;
+    std::map<std::pair<std::string, std::string>, uint64_t> d_functions;
+};
+} // namespace
+
+
+/****************************************************************************
+ *  gzip framing                                                             *
+ *  Note: the data is written with stored (uncompressed) deflate blocks,     *
+ *    which any gzip reader accepts without requiring zlib                   *
+ ****************************************************************************/
+static uint32_t crc32( const char *data, size_t N )
+{
+    static const auto table = [] {
+        std::array<uint32_t, 256> table;
+        for ( uint32_t i = 0; i < 256; i++ ) {
+            uint32_t c = i;
+            for ( int k = 0; k < 8; k++ )
+                c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for ( size_t i = 0; i < N; i++ )
+        crc = table[( crc ^ static_cast<uint8_t>( data[i] ) ) & 0xFF] ^ ( crc >> 8 );
+    return crc ^ 0xFFFFFFFFu;
+}
+static void writeGzip( std::ostream &out, const std::string &data )
+{
+    auto write32 = [&out]( uint32_t x ) {
+        char buf[4] = { static_cast<char>( x ), static_cast<char>( x >> 8 ),
+                        static_cast<char>( x >> 16 ), static_cast<char>( x >> 24 ) };
+        out.write( buf, 4 );
+    };
+    const char header[10] = { 0x1f, static_cast<char>( 0x8b ), 8, 0, 0, 0, 0, 0, 0, 3 };
+    out.write( header, sizeof( header ) );
+    size_t i = 0;
+    do {
+        uint16_t N = std::min<size_t>( data.size() - i, 0xFFFF );
+        bool last  = i + N == data.size();
+        char block[5] = { static_cast<char>( last ? 1 : 0 ), static_cast<char>( N ),
+                          static_cast<char>( N >> 8 ), static_cast<char>( ~N ),
+                          static_cast<char>( ~N >> 8 ) };
+        out.write( block, sizeof( block ) );
+        out.write( &data[i], N );
+        i += N;
+    } while ( i < data.size() );
+    write32( crc32( data.data(), data.size() ) );
+    write32( data.size() );
+}
+
+
+/****************************************************************************
+ *  Write pprof profiles                                                     *
+ ****************************************************************************/
+static void writePprof2( const multi_stack_info &stack, pprofWriter &writer,
+                         std::vector<uint64_t> &path )
+{
+    path.push_back( writer.location( stack.stack ) );
+    auto N = getSelf( stack );
+    if ( N > 0 )
+        writer.addSample( std::vector<uint64_t>( path.rbegin(), path.rend() ), N );
+    for ( const auto &child : stack.children )
+        writePprof2( child, writer, path );
+    path.pop_back();
+}
+void multi_stack_info::writePprof( std::ostream &out, const char *type, const char *unit,
+                                   int64_t period ) const
+{
+    pprofWriter writer( type, unit );
+    std::vector<uint64_t> path;
+    if ( !hasFrame( stack ) ) {
+        for ( const auto &child : children )
+            writePprof2( child, writer, path );
+    } else {
+        writePprof2( *this, writer, path );
+    }
+    writeGzip( out, writer.finalize( period ) );
+    out.flush();
+}
+void StackTrace::writePprof( std::ostream &out, const std::vector<std::vector<void *>> &samples,
+                             const std::vector<int64_t> &weights, const char *type,
+                             const char *unit, int64_t period )
+{
+    // Get the stack info for all addresses
+    std::vector<void *> addresses;
+    for ( const auto &sample : samples )
+        addresses.insert( addresses.end(), sample.begin(), sample.end() );
+    std::sort( addresses.begin(), addresses.end() );
+    addresses.erase( std::unique( addresses.begin(), addresses.end() ), addresses.end() );
+    auto info = getStackInfo( addresses );
+    // Write the samples
+    pprofWriter writer( type, unit );
+    std::vector<uint64_t> locations;
+    for ( size_t i = 0; i < samples.size(); i++ ) {
+        locations.resize( samples[i].size() );
+        for ( size_t j = 0; j < samples[i].size(); j++ ) {
+            size_t k = std::lower_bound( addresses.begin(), addresses.end(), samples[i][j] ) -
+                       addresses.begin();
+            locations[j] = writer.location( info[k] );
+        }
+        writer.addSample( locations, i < weights.size() ? weights[i] : 1 );
+    }
+    writeGzip( out, writer.finalize( period ) );
+    out.flush();
+}
@@ -0,0 +1,219 @@
+#include "StackTrace/FlatStack.h"
+#include "StackTrace/Internal.h"
+#include "StackTrace/StackTrace.h"
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+using StackTrace::flat_stack_info;
+using StackTrace::multi_stack_info;
+using StackTrace::stack_info;
+using StackTrace::Internal::hashAddress;
+using StackTrace::Internal::hashObject;
+
+
+/****************************************************************************
+ *  Hash functions                                                           *
+ *  Note: frames are inserted for both keys used by stack_info::operator==   *
+ *    (the address and the object+offset)                                    *
+ ****************************************************************************/
+static inline size_t hashChild( uint32_t parent, uint32_t frame )
+{
+    uint64_t x = ( ( static_cast<uint64_t>( parent ) << 32 ) | frame ) * 0x9E3779B97F4A7C15ull;
+    return x ^ ( x >> 29 );
+}
+
+
+/****************************************************************************
+ *  Constructors                                                             *
+ ****************************************************************************/
+flat_stack_info::flat_stack_info() { clear(); }
+flat_stack_info::flat_stack_info( const multi_stack_info &stack ) : flat_stack_info()
+{
+    add( stack );
+    if ( stack.stack.address != nullptr )
+        d_nodes[0].frame = addFrame( stack.stack );
+}
+void flat_stack_info::clear()
+{
+    d_nodes.clear();
+    d_frames.clear();
+    d_frameTable.assign( 64, 0 );
+    d_childTable.assign( 64, 0 );
+    d_nodes.push_back( { 0, npos, npos, npos, npos } );
+}
+void flat_stack_info::reserve( size_t nodes, size_t frames )
+{
+    d_nodes.reserve( nodes );
+    d_frames.reserve( frames );
+    size_t size = d_childTable.size();
+    while ( size < 2 * nodes )
+        size *= 2;
+    if ( size != d_childTable.size() )
+        rehashChildren( size );
+    size = d_frameTable.size();
+    while ( size < 4 * frames )
+        size *= 2;
+    if ( size != d_frameTable.size() )
+        rehashFrames( size );
+}
+
+
+/****************************************************************************
+ *  Frame table                                                              *
+ ****************************************************************************/
+void flat_stack_info::insertFrame( uint32_t id )
+{
+    size_t mask   = d_frameTable.size() - 1;
+    const auto &s = d_frames[id];
+    for ( size_t hash : { hashAddress( s.address ), hashObject( s ) } ) {
+        size_t k = hash & mask;
+        while ( d_frameTable[k] != 0 )
+            k = ( k + 1 ) & mask;
+        d_frameTable[k] = id + 1;
+    }
+}
+void flat_stack_info::rehashFrames( size_t size )
+{
+    d_frameTable.assign( size, 0 );
+    for ( size_t i = 0; i < d_frames.size(); i++ )
+        insertFrame( i );
+}
+uint32_t flat_stack_info::addFrame( const stack_info &s )
+{
+    // Find the first frame that matches either key
+    uint32_t id = npos;
+    size_t mask = d_frameTable.size() - 1;
+    for ( size_t hash : { hashAddress( s.address ), hashObject( s ) } ) {
+        for ( size_t k = hash & mask; d_frameTable[k] != 0; k = ( k + 1 ) & mask ) {
+            uint32_t i = d_frameTable[k] - 1;
+            if ( i < id && d_frames[i] == s )
+                id = i;
+        }
+    }
+    if ( id != npos )
+        return id;
+    // Add the frame (keeping the load factor below 1/2)
+    if ( 4 * ( d_frames.size() + 1 ) > d_frameTable.size() )
+        rehashFrames( 2 * d_frameTable.size() );
+    d_frames.push_back( s );
+    insertFrame( d_frames.size() - 1 );
+    return d_frames.size() - 1;
+}
+
+
+/****************************************************************************
+ *  Child table                                                              *
+ ****************************************************************************/
+void flat_stack_info::insertChild( uint32_t index )
+{
+    size_t mask = d_childTable.size() - 1;
+    size_t k    = hashChild( d_nodes[index].parent, d_nodes[index].frame ) & mask;
+    while ( d_childTable[k] != 0 )
+        k = ( k + 1 ) & mask;
+    d_childTable[k] = index;
+}
+void flat_stack_info::rehashChildren( size_t size )
+{
+    d_childTable.assign( size, 0 );
+    for ( size_t i = 1; i < d_nodes.size(); i++ )
+        insertChild( i );
+}
+uint32_t flat_stack_info::getChild( uint32_t parent, uint32_t frame )
+{
+    // Note: the root is never a child so 0 marks an empty slot
+    size_t mask = d_childTable.size() - 1;
+    for ( size_t k = hashChild( parent, frame ) & mask; d_childTable[k] != 0;
+          k = ( k + 1 ) & mask ) {
+        const auto &node = d_nodes[d_childTable[k]];
+        if ( node.parent == parent && node.frame == frame )
+            return d_childTable[k];
+    }
+    if ( 2 * ( d_nodes.size() + 1 ) > d_childTable.size() )
+        rehashChildren( 2 * d_childTable.size() );
+    uint32_t index = d_nodes.size();
+    d_nodes.push_back( { 0, frame, parent, npos, d_nodes[parent].firstChild } );
+    d_nodes[parent].firstChild = index;
+    insertChild( index );
+    return index;
+}
+
+
+/****************************************************************************
+ *  Add stacks                                                               *
+ ****************************************************************************/
+void flat_stack_info::add( size_t len, const stack_info *stack, int64_t count )
+{
+    uint32_t index = 0;
+    for ( size_t i = len; i > 0; i-- ) {
+        index = getChild( index, addFrame( stack[i - 1] ) );
+        d_nodes[index].N += count;
+    }
+}
+void flat_stack_info::add( size_t len, const uint32_t *frames, int64_t count )
+{
+    uint32_t index = 0;
+    for ( size_t i = len; i > 0; i-- ) {
+        index = getChild( index, frames[i - 1] );
+        d_nodes[index].N += count;
+    }
+}
+void flat_stack_info::add( const multi_stack_info &stack )
+{
+    d_nodes[0].N += stack.N;
+    std::vector<std::pair<uint32_t, const multi_stack_info *>> queue( 1, { 0, &stack } );
+    while ( !queue.empty() ) {
+        auto [parent, ptr] = queue.back();
+        queue.pop_back();
+        for ( const auto &child : ptr->children ) {
+            uint32_t index = getChild( parent, addFrame( child.stack ) );
+            d_nodes[index].N += child.N;
+            queue.emplace_back( index, &child );
+        }
+    }
+}
+void flat_stack_info::add( const flat_stack_info &rhs )
+{
+    // The parent of a node is always stored before the node, so the nodes
+    // can be merged in order (the siblings are visited in the order they were added)
+    std::vector<uint32_t> frames( rhs.d_frames.size(), npos );
+    std::vector<uint32_t> nodes( rhs.d_nodes.size(), npos );
+    nodes[0] = 0;
+    d_nodes[0].N += rhs.d_nodes[0].N;
+    for ( size_t i = 1; i < rhs.d_nodes.size(); i++ ) {
+        const auto &node = rhs.d_nodes[i];
+        if ( frames[node.frame] == npos )
+            frames[node.frame] = addFrame( rhs.d_frames[node.frame] );
+        nodes[i] = getChild( nodes[node.parent], frames[node.frame] );
+        d_nodes[nodes[i]].N += node.N;
+    }
+}
+
+
+/****************************************************************************
+ *  Convert to a multi_stack_info                                            *
+ *  Note: the children of each node are allocated once with the final size   *
+ ****************************************************************************/
+static void convert( const flat_stack_info &flat, uint32_t index, multi_stack_info &stack )
+{
+    const auto &node = flat[index];
+    stack.N          = node.N;
+    if ( node.frame != flat_stack_info::npos )
+        stack.stack = flat.frame( node.frame );
+    size_t Nc = 0;
+    for ( uint32_t i = node.firstChild; i != flat_stack_info::npos; i = flat[i].nextSibling )
+        Nc++;
+    stack.children.resize( Nc );
+    for ( uint32_t i = node.firstChild; i != flat_stack_info::npos; i = flat[i].nextSibling )
+        convert( flat, i, stack.children[--Nc] );
+}
+multi_stack_info flat_stack_info::toMultiStack() const
+{
+    multi_stack_info stack;
+    convert( *this, 0, stack );
+    return stack;
+}
@@ -0,0 +1,298 @@
+#include "StackTrace/Profiler.h"
+#include "StackTrace/StackTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+
+// Detect the OS
+// clang-format off
+#if defined( WIN32 ) || defined( _WIN32 ) || defined( WIN64 ) || defined( _WIN64 ) || defined( _MSC_VER )
+    #define USE_WINDOWS
+#elif defined( __APPLE__ )
+    #define USE_MAC
+#elif defined( __linux ) || defined( __linux__ ) || defined( __unix ) || defined( __posix )
+    #define USE_LINUX
+#else
+    #error Unknown OS
+#endif
+#if defined( USE_HEAP_PROFILER ) && defined( USE_LINUX ) && defined( __GLIBC__ )
+    #define USE_HEAP_HOOKS
+#endif
+// clang-format on
+
+
+// Include system dependent headers
+// clang-format off
+#ifdef USE_HEAP_HOOKS
+    #include <execinfo.h>
+    #include <malloc.h>
+#endif
+// clang-format on
+
+
+#ifdef USE_HEAP_HOOKS
+
+
+// The glibc allocator functions (used to forward the calls)
+extern "C" {
+void *__libc_malloc( size_t );
+void __libc_free( void * );
+void *__libc_calloc( size_t, size_t );
+void *__libc_realloc( void *, size_t );
+void *__libc_memalign( size_t, size_t );
+}
+
+
+/****************************************************************************
+ *  Table of the live sampled allocations                                    *
+ *  Note: the table is lock-free and uses open addressing with a bounded     *
+ *    probe window.  The count of live entries for each home slot lets free  *
+ *    skip the search for the (vast majority of) unsampled pointers.         *
+ ****************************************************************************/
+static constexpr int heapDepth        = 32;
+static constexpr size_t heapTableSize = 0x4000;
+static constexpr size_t heapProbe     = 64;
+struct heapEntry {
+    std::atomic<void *> ptr;
+    size_t bytes;
+    int64_t weight;
+    int depth;
+    void *trace[heapDepth];
+};
+static void *const reservedEntry = reinterpret_cast<void *>( 1 );
+static heapEntry heapTable[heapTableSize];
+static std::atomic<uint16_t> heapHomeCount[heapTableSize];
+static std::atomic<size_t> heapSampleBytes( 0 );
+static std::atomic<bool> heapTracked( false );
+static std::atomic<size_t> heapDropped( 0 );
+static inline size_t heapHome( const void *ptr )
+{
+    return ( ( reinterpret_cast<uintptr_t>( ptr ) >> 4 ) * 0x9E3779B97F4A7C15ull ) >> 50;
+}
+static bool insertAllocation( void *ptr, size_t bytes, int64_t weight, void *const *trace,
+                              int depth )
+{
+    size_t home = heapHome( ptr );
+    for ( size_t i = 0; i < heapProbe; i++ ) {
+        auto &entry    = heapTable[( home + i ) % heapTableSize];
+        void *expected = nullptr;
+        if ( !entry.ptr.compare_exchange_strong( expected, reservedEntry ) )
+            continue;
+        entry.bytes  = bytes;
+        entry.weight = weight;
+        entry.depth  = depth;
+        memcpy( entry.trace, trace, depth * sizeof( void * ) );
+        heapHomeCount[home]++;
+        entry.ptr.store( ptr, std::memory_order_release );
+        return true;
+    }
+    return false;
+}
+static inline void removeAllocation( void *ptr )
+{
+    if ( !heapTracked.load( std::memory_order_relaxed ) || !ptr )
+        return;
+    size_t home = heapHome( ptr );
+    if ( heapHomeCount[home].load( std::memory_order_relaxed ) == 0 )
+        return;
+    for ( size_t i = 0; i < heapProbe; i++ ) {
+        auto &entry = heapTable[( home + i ) % heapTableSize];
+        if ( entry.ptr.load( std::memory_order_relaxed ) == ptr ) {
+            heapHomeCount[home]--;
+            entry.ptr.store( nullptr, std::memory_order_release );
+            return;
+        }
+    }
+}
+
+
+/****************************************************************************
+ *  Sample the allocations                                                   *
+ *  Note: the bytes between samples are exponentially distributed so the     *
+ *    samples form a Poisson process over the allocated bytes                *
+ ****************************************************************************/
+struct heapThreadState {
+    int64_t remaining = 0;
+    uint64_t random   = 0;
+    bool active       = false;
+};
+static thread_local heapThreadState heapState __attribute__( ( tls_model( "initial-exec" ) ) );
+static int64_t nextSample( heapThreadState &state, size_t mean )
+{
+    if ( state.random == 0 )
+        state.random = reinterpret_cast<uintptr_t>( &state ) * 0x9E3779B97F4A7C15ull + 1;
+    state.random ^= state.random >> 12;
+    state.random ^= state.random << 25;
+    state.random ^= state.random >> 27;
+    double u = ( ( state.random * 0x2545F4914F6CDD1Dull ) >> 11 ) * ( 1.0 / 9007199254740992.0 );
+    return static_cast<int64_t>( -std::log( 1.0 - u ) * mean ) + 1;
+}
+static __attribute__( ( noinline ) ) void recordAllocation( void *ptr, size_t bytes,
+                                                            const void *caller )
+{
+    auto &state = heapState;
+    size_t mean = heapSampleBytes.load( std::memory_order_relaxed );
+    if ( state.active || mean == 0 )
+        return;
+    state.active = true;
+    if ( state.random == 0 ) {
+        // First allocation on this thread: start the sampling interval
+        state.remaining += nextSample( state, mean );
+        if ( state.remaining > 0 ) {
+            state.active = false;
+            return;
+        }
+    }
+    state.remaining = nextSample( state, mean );
+    // Get the call stack (starting at the caller of the allocation function)
+    void *trace[heapDepth + 8];
+    int count = ::backtrace( trace, heapDepth + 8 );
+    int start = 0;
+    for ( int i = 0; i < count; i++ ) {
+        if ( trace[i] == caller ) {
+            start = i;
+            break;
+        }
+    }
+    int depth = std::min( count - start, heapDepth );
+    // Unbias the sample: the probability of sampling an allocation is 1-exp(-bytes/mean)
+    double p       = 1.0 - std::exp( -static_cast<double>( bytes ) / mean );
+    int64_t weight = static_cast<int64_t>( bytes / p + 0.5 );
+    if ( !insertAllocation( ptr, bytes, weight, &trace[start], depth ) )
+        heapDropped++;
+    state.active = false;
+}
+static inline void *sampleAllocation( void *ptr, size_t bytes, const void *caller )
+{
+    if ( heapSampleBytes.load( std::memory_order_relaxed ) == 0 || !ptr )
+        return ptr;
+    auto &state = heapState;
+    state.remaining -= bytes;
+    if ( state.remaining <= 0 )
+        recordAllocation( ptr, bytes, caller );
+    return ptr;
+}
+
+
+/****************************************************************************
+ *  Allocator functions                                                      *
+ *  Note: operator new/delete in libstdc++ call malloc/free so they are also *
+ *    sampled                                                                *
+ ****************************************************************************/
+#define CALLER() __builtin_return_address( 0 )
+extern "C" {
+void *malloc( size_t size ) noexcept
+{
+    return sampleAllocation( __libc_malloc( size ), size, CALLER() );
+}
+void free( void *ptr ) noexcept
+{
+    removeAllocation( ptr );
+    __libc_free( ptr );
+}
+void *calloc( size_t N, size_t size ) noexcept
+{
+    return sampleAllocation( __libc_calloc( N, size ), N * size, CALLER() );
+}
+void *realloc( void *ptr, size_t size ) noexcept
+{
+    // Note: the original block is still live if the call fails (realloc( ptr, 0 ) frees it)
+    void *ptr2 = __libc_realloc( ptr, size );
+    if ( ptr2 || size == 0 )
+        removeAllocation( ptr );
+    return sampleAllocation( ptr2, size, CALLER() );
+}
+void *memalign( size_t alignment, size_t size ) noexcept
+{
+    return sampleAllocation( __libc_memalign( alignment, size ), size, CALLER() );
+}
+void *aligned_alloc( size_t alignment, size_t size ) noexcept
+{
+    return sampleAllocation( __libc_memalign( alignment, size ), size, CALLER() );
+}
+int posix_memalign( void **ptr, size_t alignment, size_t size ) noexcept
+{
+    if ( alignment % sizeof( void * ) != 0 || ( alignment & ( alignment - 1 ) ) != 0 )
+        return EINVAL;
+    void *tmp = __libc_memalign( alignment, size );
+    if ( !tmp )
+        return ENOMEM;
+    *ptr = sampleAllocation( tmp, size, CALLER() );
+    return 0;
+}
+}
+
+
+/****************************************************************************
+ *  Start/stop the heap profiler                                             *
+ ****************************************************************************/
+void StackTrace::Profiler::startHeap( size_t sampleBytes )
+{
+    // Warm up backtrace (the first call may allocate memory)
+    void *trace[4];
+    ::backtrace( trace, 4 );
+    heapTracked = true;
+    heapDropped = 0;
+    heapSampleBytes.store( std::max<size_t>( sampleBytes, 1 ) );
+}
+void StackTrace::Profiler::stopHeap() { heapSampleBytes.store( 0 ); }
+size_t StackTrace::Profiler::heapDroppedSamples() { return heapDropped.load(); }
+StackTrace::multi_stack_info StackTrace::Profiler::getHeapProfile()
+{
+    // Get the live allocations
+    // Note: the entry is only used if it did not change while it was copied
+    std::map<std::vector<void *>, int64_t> data;
+    std::vector<void *> trace;
+    for ( auto &entry : heapTable ) {
+        void *ptr = entry.ptr.load( std::memory_order_acquire );
+        if ( ptr == nullptr || ptr == reservedEntry )
+            continue;
+        trace.assign( entry.trace, entry.trace + std::min( entry.depth, heapDepth ) );
+        int64_t weight = entry.weight;
+        if ( entry.ptr.load( std::memory_order_acquire ) == ptr )
+            data[trace] += weight;
+    }
+    // Get the stack data for all pointers
+    std::vector<void *> addresses;
+    for ( const auto &tmp : data )
+        addresses.insert( addresses.end(), tmp.first.begin(), tmp.first.end() );
+    std::sort( addresses.begin(), addresses.end() );
+    addresses.erase( std::unique( addresses.begin(), addresses.end() ), addresses.end() );
+    auto stack_data = getStackInfo( addresses );
+    // Create the profile
+    multi_stack_info profile;
+    std::vector<stack_info> stack;
+    for ( const auto &tmp : data ) {
+        stack.resize( tmp.first.size() );
+        for ( size_t j = 0; j < tmp.first.size(); j++ ) {
+            size_t k = std::lower_bound( addresses.begin(), addresses.end(), tmp.first[j] ) -
+                       addresses.begin();
+            stack[j] = stack_data[k];
+        }
+        profile.N += tmp.second;
+        profile.add( stack.size(), stack.data(), tmp.second );
+    }
+    return profile;
+}
+
+
+#else
+
+
+void StackTrace::Profiler::startHeap( size_t ) {}
+void StackTrace::Profiler::stopHeap() {}
+size_t StackTrace::Profiler::heapDroppedSamples() { return 0; }
+StackTrace::multi_stack_info StackTrace::Profiler::getHeapProfile()
+{
+    return StackTrace::multi_stack_info();
+}
+
+
+#endif
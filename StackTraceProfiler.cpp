@@ -0,0 +1,705 @@
+#include "StackTrace/Internal.h"
+#include "StackTrace/Profiler.h"
+#include "StackTrace/StackTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+
+// Detect the OS
+// clang-format off
+#if defined( WIN32 ) || defined( _WIN32 ) || defined( WIN64 ) || defined( _WIN64 ) || defined( _MSC_VER )
+    #define USE_WINDOWS
+#elif defined( __APPLE__ )
+    #define USE_MAC
+#elif defined( __linux ) || defined( __linux__ ) || defined( __unix ) || defined( __posix )
+    #define USE_LINUX
+#else
+    #error Unknown OS
+#endif
+// clang-format on
+
+
+// Include system dependent headers
+// clang-format off
+#ifdef USE_LINUX
+    #include <csignal>
+    #include <ctime>
+    #include <execinfo.h>
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #ifndef sigev_notify_thread_id
+        #define sigev_notify_thread_id _sigev_un._tid
+    #endif
+#endif
+// clang-format on
+
+
+namespace StackTrace::Profiler {
+
+
+/****************************************************************************
+ *  Raw call stacks and the conversion to a profile                          *
+ ****************************************************************************/
+struct stackHash {
+    size_t operator()( const std::vector<void *> &x ) const
+    {
+        size_t hash = 0xcbf29ce484222325;
+        for ( auto ptr : x )
+            hash = ( hash ^ reinterpret_cast<size_t>( ptr ) ) * 0x100000001b3;
+        return hash;
+    }
+};
+using sampleMap = std::unordered_map<std::vector<void *>, int64_t, stackHash>;
+class symbolTable final
+{
+public:
+    explicit symbolTable( const std::vector<const sampleMap *> &data )
+    {
+        for ( auto ptr : data ) {
+            for ( const auto &tmp : *ptr )
+                d_address.insert( d_address.end(), tmp.first.begin(), tmp.first.end() );
+        }
+        std::sort( d_address.begin(), d_address.end() );
+        d_address.erase( std::unique( d_address.begin(), d_address.end() ), d_address.end() );
+        d_info = getStackInfo( d_address );
+    }
+    const stack_info &operator[]( void *address ) const
+    {
+        size_t k = std::lower_bound( d_address.begin(), d_address.end(), address ) -
+                   d_address.begin();
+        return d_info[k];
+    }
+
+private:
+    std::vector<void *> d_address;
+    std::vector<stack_info> d_info;
+};
+static multi_stack_info generateProfile( const sampleMap &data )
+{
+    symbolTable symbols( { &data } );
+    multi_stack_info profile;
+    std::vector<stack_info> stack;
+    for ( const auto &tmp : data ) {
+        stack.resize( tmp.first.size() );
+        for ( size_t j = 0; j < tmp.first.size(); j++ )
+            stack[j] = symbols[tmp.first[j]];
+        profile.N += tmp.second;
+        profile.add( stack.size(), stack.data(), tmp.second );
+    }
+    return profile;
+}
+
+
+#ifdef USE_LINUX
+
+
+static constexpr int maxDepth       = 256;     // Maximum depth of a sample
+static constexpr int maxThreads     = 1024;    // Maximum number of threads to sample
+static constexpr size_t bufferWords = 0x10000; // Size of the buffer for each thread
+
+
+/****************************************************************************
+ *  Lock-free ring buffer of raw call stacks                                 *
+ *  Note: the only producer is the signal handler on the sampled thread and  *
+ *    the only consumer is the thread collecting the samples                 *
+ ****************************************************************************/
+class sampleBuffer final
+{
+public:
+    explicit sampleBuffer( size_t capacity ) : d_data( capacity, nullptr ) {}
+    bool push( void *const *trace, int count )
+    {
+        size_t head = d_head.load( std::memory_order_relaxed );
+        size_t tail = d_tail.load( std::memory_order_acquire );
+        if ( head + count + 1 - tail > d_data.size() )
+            return false;
+        d_data[head % d_data.size()] = reinterpret_cast<void *>( static_cast<intptr_t>( count ) );
+        for ( int i = 0; i < count; i++ )
+            d_data[( head + i + 1 ) % d_data.size()] = trace[i];
+        d_head.store( head + count + 1, std::memory_order_release );
+        return true;
+    }
+    template<class FUN>
+    void pop( FUN &&fun )
+    {
+        size_t tail = d_tail.load( std::memory_order_relaxed );
+        size_t head = d_head.load( std::memory_order_acquire );
+        void *trace[maxDepth];
+        while ( tail < head ) {
+            auto count = reinterpret_cast<intptr_t>( d_data[tail % d_data.size()] );
+            for ( intptr_t i = 0; i < count; i++ )
+                trace[i] = d_data[( tail + i + 1 ) % d_data.size()];
+            tail += count + 1;
+            fun( trace, static_cast<int>( count ) );
+        }
+        d_tail.store( tail, std::memory_order_release );
+    }
+
+private:
+    std::vector<void *> d_data;
+    std::atomic<size_t> d_head = { 0 };
+    std::atomic<size_t> d_tail = { 0 };
+};
+
+
+/****************************************************************************
+ *  Per-thread sampling state                                                *
+ ****************************************************************************/
+struct threadSampler {
+    int id;
+    timer_t timer;
+    sampleBuffer buffer;
+    std::atomic<size_t> dropped = { 0 };
+    threadSampler( int id_ ) : id( id_ ), timer( nullptr ), buffer( bufferWords ) {}
+};
+static std::atomic<threadSampler *> samplerSlots[maxThreads];
+static std::atomic<int> activeHandlers( 0 );
+static std::atomic<int64_t> queriedThreadId( 0 );
+static std::atomic<int> samplerGeneration( 0 );
+static std::mutex profilerMutex;
+static std::mutex samplesMutex;
+static std::shared_ptr<std::thread> collectorThread;
+static std::atomic<bool> collectorRunning( false );
+static std::map<std::thread::native_handle_type, threadSampler *> samplers;
+static sampleMap samples;
+static std::atomic<size_t> dropped( 0 );
+static int profilerHz = 0;
+static sampleClock profilerClock = sampleClock::wall;
+
+
+/****************************************************************************
+ *  Signal handler                                                           *
+ *  Note: timer signals record a sample, queued signals return the thread id *
+ ****************************************************************************/
+static void profilerSignalHandler( int, siginfo_t *info, void *context )
+{
+    int err = errno;
+    if ( info->si_code == SI_QUEUE ) {
+        int64_t query = info->si_value.sival_int;
+        queriedThreadId.store( ( query << 32 ) + syscall( SYS_gettid ) );
+    } else if ( info->si_code == SI_TIMER ) {
+        activeHandlers++;
+        int id       = info->si_value.sival_int;
+        auto sampler = samplerSlots[id % maxThreads].load();
+        if ( sampler && sampler->id == id ) {
+            void *trace[maxDepth];
+            int count = Internal::backtrace_signal( trace, maxDepth, context );
+            if ( !sampler->buffer.push( trace, count ) )
+                sampler->dropped++;
+        }
+        activeHandlers--;
+    }
+    errno = err;
+}
+static void installSignalHandler()
+{
+    // Note: the handler is never removed since a timer signal may still be pending
+    static bool installed = false;
+    if ( installed )
+        return;
+    struct sigaction sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sigfillset( &sa.sa_mask );
+    sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+    sa.sa_sigaction = profilerSignalHandler;
+    sigaction( SIGPROF, &sa, nullptr );
+    // Warm up backtrace (the first call may allocate memory)
+    void *trace[4];
+    ::backtrace( trace, 4 );
+    installed = true;
+}
+
+
+/****************************************************************************
+ *  Get the kernel thread id for a thread                                    *
+ *  Note: the queries are serialized since there is a single result slot     *
+ *    (the profiler and the wall-clock profiler may both query threads)      *
+ ****************************************************************************/
+static std::mutex threadIdMutex;
+static int getThreadId( std::thread::native_handle_type thread )
+{
+    if ( thread == pthread_self() )
+        return syscall( SYS_gettid );
+    std::lock_guard<std::mutex> lock( threadIdMutex );
+    static int query = 0;
+    query            = ( query + 1 ) & 0x7FFFFFFF;
+    union sigval value;
+    value.sival_int = query;
+    if ( pthread_sigqueue( thread, SIGPROF, value ) != 0 )
+        return -1;
+    auto t1 = std::chrono::steady_clock::now();
+    while ( std::chrono::steady_clock::now() - t1 < std::chrono::milliseconds( 150 ) ) {
+        auto id = queriedThreadId.load();
+        if ( ( id >> 32 ) == query )
+            return static_cast<int>( id & 0xFFFFFFFF );
+        std::this_thread::yield();
+    }
+    return -1;
+}
+
+
+/****************************************************************************
+ *  Start/stop sampling a thread                                             *
+ ****************************************************************************/
+static void collectSamples( threadSampler *sampler )
+{
+    auto fun = []( void *const *trace, int count ) {
+        samples[std::vector<void *>( trace, trace + count )]++;
+    };
+    std::lock_guard<std::mutex> lock( samplesMutex );
+    sampler->buffer.pop( fun );
+    dropped += sampler->dropped.exchange( 0 );
+}
+static threadSampler *startThread( std::thread::native_handle_type thread )
+{
+    // Get a free slot
+    int slot = -1;
+    for ( int i = 0; i < maxThreads && slot == -1; i++ ) {
+        if ( samplerSlots[i].load() == nullptr )
+            slot = i;
+    }
+    int tid = getThreadId( thread );
+    if ( slot == -1 || tid <= 0 )
+        return nullptr;
+    // Get the clock to use
+    clockid_t clock = CLOCK_MONOTONIC;
+    if ( profilerClock == sampleClock::cpu ) {
+        if ( pthread_getcpuclockid( thread, &clock ) != 0 )
+            return nullptr;
+    }
+    // Create the timer
+    int generation = ( samplerGeneration++ ) % ( 0x7FFFFFFF / maxThreads );
+    auto sampler   = new threadSampler( generation * maxThreads + slot );
+    struct sigevent sev;
+    memset( &sev, 0, sizeof( sev ) );
+    sev.sigev_notify           = SIGEV_THREAD_ID;
+    sev.sigev_signo            = SIGPROF;
+    sev.sigev_value.sival_int  = sampler->id;
+    sev.sigev_notify_thread_id = tid;
+    if ( timer_create( clock, &sev, &sampler->timer ) != 0 ) {
+        delete sampler;
+        return nullptr;
+    }
+    samplerSlots[slot] = sampler;
+    // Start the timer
+    long ns = 1000000000L / profilerHz;
+    struct itimerspec its;
+    its.it_interval.tv_sec  = ns / 1000000000L;
+    its.it_interval.tv_nsec = ns % 1000000000L;
+    its.it_value            = its.it_interval;
+    timer_settime( sampler->timer, 0, &its, nullptr );
+    return sampler;
+}
+static void stopThread( threadSampler *sampler )
+{
+    timer_delete( sampler->timer );
+    samplerSlots[sampler->id % maxThreads] = nullptr;
+    while ( activeHandlers.load() != 0 )
+        std::this_thread::yield();
+    collectSamples( sampler );
+    delete sampler;
+}
+static void updateThreads()
+{
+    auto threads = registeredThreads();
+    for ( auto it = samplers.begin(); it != samplers.end(); ) {
+        if ( std::find( threads.begin(), threads.end(), it->first ) == threads.end() ) {
+            stopThread( it->second );
+            it = samplers.erase( it );
+        } else {
+            ++it;
+        }
+    }
+    for ( auto thread : threads ) {
+        if ( samplers.find( thread ) == samplers.end() ) {
+            auto sampler = startThread( thread );
+            if ( sampler )
+                samplers[thread] = sampler;
+        }
+    }
+}
+
+
+/****************************************************************************
+ *  Thread to collect the samples and update the threads                     *
+ ****************************************************************************/
+static void runCollectorThread()
+{
+    while ( collectorRunning ) {
+        updateThreads();
+        for ( auto &tmp : samplers )
+            collectSamples( tmp.second );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    }
+}
+
+
+/****************************************************************************
+ *  Start/stop the profiler                                                  *
+ ****************************************************************************/
+void start( int hz, sampleClock clock )
+{
+    std::lock_guard<std::mutex> lock( profilerMutex );
+    if ( collectorThread || hz <= 0 )
+        return;
+    installSignalHandler();
+    profilerHz    = hz;
+    profilerClock = clock;
+    samples.clear();
+    dropped = 0;
+    updateThreads();
+    collectorRunning = true;
+    collectorThread  = std::make_shared<std::thread>( runCollectorThread );
+}
+multi_stack_info stop()
+{
+    std::lock_guard<std::mutex> lock( profilerMutex );
+    if ( !collectorThread )
+        return multi_stack_info();
+    collectorRunning = false;
+    collectorThread->join();
+    collectorThread.reset();
+    for ( auto &tmp : samplers )
+        stopThread( tmp.second );
+    samplers.clear();
+    sampleMap data;
+    std::swap( data, samples );
+    return generateProfile( data );
+}
+multi_stack_info flush()
+{
+    std::lock_guard<std::mutex> lock( profilerMutex );
+    sampleMap data;
+    {
+        std::lock_guard<std::mutex> lock2( samplesMutex );
+        std::swap( data, samples );
+    }
+    return generateProfile( data );
+}
+bool running() { return collectorRunning.load(); }
+size_t droppedSamples() { return dropped.load(); }
+
+
+/****************************************************************************
+ *  Wall-clock profiler                                                      *
+ *  Note: the state and the current system call of each thread are read      *
+ *    from /proc before the thread is interrupted to get the call stack      *
+ ****************************************************************************/
+struct threadState {
+    bool blocked = false;
+    long syscall = -1;
+};
+static std::mutex wallClockMutex;
+static std::shared_ptr<std::thread> wallClockThread;
+static std::atomic<bool> wallClockRunning( false );
+static sampleMap wallClockRunningSamples;
+static std::map<long, sampleMap> wallClockBlockedSamples;
+static int readFile( const char *filename, char *buffer, int size )
+{
+    int fid = open( filename, O_RDONLY );
+    if ( fid < 0 )
+        return 0;
+    int N = std::max<int>( read( fid, buffer, size - 1 ), 0 );
+    close( fid );
+    buffer[N] = 0;
+    return N;
+}
+static threadState getThreadState( int tid )
+{
+    threadState state;
+    char filename[64], buffer[512];
+    // Read the thread state (the command name may contain spaces or parentheses)
+    snprintf( filename, sizeof( filename ), "/proc/self/task/%i/stat", tid );
+    if ( readFile( filename, buffer, sizeof( buffer ) ) == 0 )
+        return state;
+    auto ptr = strrchr( buffer, ')' );
+    if ( !ptr || ptr[1] == 0 )
+        return state;
+    state.blocked = ptr[2] != 'R';
+    // Read the current system call ("running", "-1 sp pc", or "nr args sp pc")
+    if ( state.blocked ) {
+        snprintf( filename, sizeof( filename ), "/proc/self/task/%i/syscall", tid );
+        if ( readFile( filename, buffer, sizeof( buffer ) ) > 0 && buffer[0] != 'r' )
+            state.syscall = strtol( buffer, nullptr, 10 );
+    }
+    return state;
+}
+static const char *getSyscallName( long syscall )
+{
+    switch ( syscall ) {
+    case SYS_futex:
+        return "futex";
+    case SYS_read:
+        return "read";
+    case SYS_readv:
+        return "readv";
+    case SYS_pread64:
+        return "pread64";
+    case SYS_write:
+        return "write";
+    case SYS_writev:
+        return "writev";
+    case SYS_pwrite64:
+        return "pwrite64";
+    case SYS_recvfrom:
+        return "recvfrom";
+    case SYS_recvmsg:
+        return "recvmsg";
+    case SYS_sendto:
+        return "sendto";
+    case SYS_sendmsg:
+        return "sendmsg";
+    case SYS_accept4:
+        return "accept4";
+    case SYS_connect:
+        return "connect";
+    case SYS_ppoll:
+        return "ppoll";
+    case SYS_pselect6:
+        return "pselect6";
+    case SYS_epoll_pwait:
+        return "epoll_pwait";
+    case SYS_nanosleep:
+        return "nanosleep";
+    case SYS_clock_nanosleep:
+        return "clock_nanosleep";
+    case SYS_wait4:
+        return "wait4";
+    case SYS_waitid:
+        return "waitid";
+    case SYS_sched_yield:
+        return "sched_yield";
+    case SYS_fsync:
+        return "fsync";
+    case SYS_openat:
+        return "openat";
+#ifdef SYS_poll
+    case SYS_poll:
+        return "poll";
+#endif
+#ifdef SYS_select
+    case SYS_select:
+        return "select";
+#endif
+#ifdef SYS_epoll_wait
+    case SYS_epoll_wait:
+        return "epoll_wait";
+#endif
+#ifdef SYS_accept
+    case SYS_accept:
+        return "accept";
+#endif
+#ifdef SYS_pause
+    case SYS_pause:
+        return "pause";
+#endif
+    default:
+        return nullptr;
+    }
+}
+static stack_info getBlockedTag( long syscall )
+{
+    // Note: the address is used to identify the tag when merging stacks
+    stack_info tag;
+    tag.address  = reinterpret_cast<void *>( syscall + 2 );
+    tag.address2 = tag.address;
+    strcpy( tag.object.data(), "[kernel]" );
+    auto name = getSyscallName( syscall );
+    if ( syscall == -2 )
+        strcpy( tag.function.data(), "[MPI progress]" );
+    else if ( syscall == -1 )
+        strcpy( tag.function.data(), "[blocked]" );
+    else if ( name )
+        snprintf( tag.function.data(), tag.function.size(), "[%s]", name );
+    else
+        snprintf( tag.function.data(), tag.function.size(), "[syscall %li]", syscall );
+    return tag;
+}
+static bool isMPI( const std::vector<stack_info> &stack )
+{
+    for ( const auto &tmp : stack ) {
+        auto fun = tmp.function.data();
+        if ( strncmp( fun, "MPI_", 4 ) == 0 || strncmp( fun, "PMPI_", 5 ) == 0 )
+            return true;
+    }
+    return false;
+}
+static void runWallClockThread( int hz )
+{
+    std::map<std::thread::native_handle_type, int> tids;
+    auto period = std::chrono::nanoseconds( 1000000000L / hz );
+    auto next   = std::chrono::steady_clock::now();
+    while ( wallClockRunning ) {
+        // Get the thread ids
+        auto threads = registeredThreads();
+        std::map<std::thread::native_handle_type, int> tids2;
+        for ( auto thread : threads ) {
+            auto it       = tids.find( thread );
+            tids2[thread] = it == tids.end() ? getThreadId( thread ) : it->second;
+        }
+        std::swap( tids, tids2 );
+        // Get the state of all threads and then their call stacks
+        std::vector<threadState> state( threads.size() );
+        for ( size_t i = 0; i < threads.size(); i++ ) {
+            if ( tids[threads[i]] > 0 )
+                state[i] = getThreadState( tids[threads[i]] );
+        }
+        for ( size_t i = 0; i < threads.size(); i++ ) {
+            auto trace = backtrace( threads[i] );
+            if ( trace.empty() )
+                continue;
+            std::lock_guard<std::mutex> lock( samplesMutex );
+            if ( state[i].blocked )
+                wallClockBlockedSamples[state[i].syscall][trace]++;
+            else
+                wallClockRunningSamples[trace]++;
+        }
+        // Wait for the next sample
+        next += period;
+        auto now = std::chrono::steady_clock::now();
+        if ( next < now )
+            next = now;
+        while ( wallClockRunning && std::chrono::steady_clock::now() < next )
+            std::this_thread::sleep_for( std::min<std::chrono::nanoseconds>(
+                next - std::chrono::steady_clock::now(), std::chrono::milliseconds( 50 ) ) );
+    }
+}
+void startWallClock( int hz )
+{
+    std::lock_guard<std::mutex> lock( wallClockMutex );
+    if ( wallClockThread || hz <= 0 )
+        return;
+    installSignalHandler();
+    wallClockRunningSamples.clear();
+    wallClockBlockedSamples.clear();
+    wallClockRunning = true;
+    wallClockThread  = std::make_shared<std::thread>( runWallClockThread, hz );
+}
+wallClockProfile stopWallClock()
+{
+    std::lock_guard<std::mutex> lock( wallClockMutex );
+    if ( !wallClockThread )
+        return wallClockProfile();
+    wallClockRunning = false;
+    wallClockThread->join();
+    wallClockThread.reset();
+    sampleMap running;
+    std::map<long, sampleMap> blocked;
+    std::swap( running, wallClockRunningSamples );
+    std::swap( blocked, wallClockBlockedSamples );
+    // Create the profiles
+    // Note: running threads inside MPI are assumed to be polling for progress
+    std::vector<const sampleMap *> data( 1, &running );
+    for ( const auto &tmp : blocked )
+        data.push_back( &tmp.second );
+    symbolTable symbols( data );
+    wallClockProfile profile;
+    std::vector<stack_info> stack;
+    static constexpr long notBlocked = -3;
+    auto add = [&symbols, &stack, &profile]( const sampleMap &data, long syscall ) {
+        for ( const auto &tmp : data ) {
+            // Note: the first entry is reserved for the blocking call
+            stack.resize( tmp.first.size() + 1 );
+            stack[0].clear();
+            for ( size_t j = 0; j < tmp.first.size(); j++ )
+                stack[j + 1] = symbols[tmp.first[j]];
+            long call = syscall == notBlocked && isMPI( stack ) ? -2 : syscall;
+            if ( call == notBlocked ) {
+                profile.running.N += tmp.second;
+                profile.running.add( tmp.first.size(), &stack[1], tmp.second );
+            } else {
+                stack[0] = getBlockedTag( call );
+                profile.blocked.N += tmp.second;
+                profile.blocked.add( stack.size(), stack.data(), tmp.second );
+            }
+        }
+    };
+    add( running, notBlocked );
+    for ( const auto &tmp : blocked )
+        add( tmp.second, tmp.first );
+    return profile;
+}
+bool wallClockIsRunning() { return wallClockRunning.load(); }
+
+
+
+#else
+
+
+void start( int, sampleClock ) {}
+multi_stack_info stop() { return multi_stack_info(); }
+multi_stack_info flush() { return multi_stack_info(); }
+bool running() { return false; }
+size_t droppedSamples() { return 0; }
+void startWallClock( int ) {}
+wallClockProfile stopWallClock() { return wallClockProfile(); }
+bool wallClockIsRunning() { return false; }
+
+
+#endif
+
+
+} // namespace StackTrace::Profiler
+
+
+/****************************************************************************
+ *  Mutex contention profiler                                                *
+ *  Note: the wait times are stored in a sharded table to avoid serializing  *
+ *    the threads that record the contention                                 *
+ ****************************************************************************/
+namespace StackTrace {
+struct alignas( 64 ) contentionShard {
+    std::mutex mutex;
+    Profiler::sampleMap wait;
+};
+static contentionShard contentionShards[64];
+void profiled_mutex::lockContended()
+{
+    // Note: the wait is recorded by unlock (outside of the critical section)
+    auto trace = backtrace( thisThread(), 64, 1 );
+    auto t1    = std::chrono::steady_clock::now();
+    d_mutex.lock();
+    auto t2   = std::chrono::steady_clock::now();
+    d_wait    = std::chrono::duration_cast<std::chrono::nanoseconds>( t2 - t1 ).count();
+    d_trace   = std::move( trace );
+    d_pending = true;
+}
+void profiled_mutex::unlockContended()
+{
+    auto trace = std::move( d_trace );
+    auto ns    = d_wait;
+    d_pending  = false;
+    d_mutex.unlock();
+    auto &shard = contentionShards[std::hash<std::thread::id>()( std::this_thread::get_id() ) % 64];
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    shard.wait[trace] += ns;
+}
+multi_stack_info profiled_mutex::report()
+{
+    Profiler::sampleMap data;
+    for ( auto &shard : contentionShards ) {
+        std::lock_guard<std::mutex> lock( shard.mutex );
+        for ( const auto &tmp : shard.wait )
+            data[tmp.first] += tmp.second;
+    }
+    return Profiler::generateProfile( data );
+}
+void profiled_mutex::reset()
+{
+    for ( auto &shard : contentionShards ) {
+        std::lock_guard<std::mutex> lock( shard.mutex );
+        shard.wait.clear();
+    }
+}
+} // namespace StackTrace
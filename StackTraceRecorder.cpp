@@ -0,0 +1,288 @@
+#include "StackTrace/Profiler.h"
+#include "StackTrace/StackTrace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using StackTrace::multi_stack_info;
+
+
+/****************************************************************************
+ *  Segment format                                                           *
+ *  Each segment starts with an 8 byte header followed by the records.  A    *
+ *  record is a fixed header (magic, length, checksum of the payload stored  *
+ *  as little-endian 32-bit integers) and the payload: the time range of the *
+ *  flush (varints) and the profile (multi_stack_info::packCompact)          *
+ ****************************************************************************/
+static constexpr char segmentHeader[8]   = { 'S', 'T', 'P', 'R', 'O', 'F', '0', '2' };
+static constexpr uint32_t recordMagic    = 0x43525453; // "STRC"
+static constexpr size_t recordHeaderSize = 12;
+static uint32_t checksum( const char *data, size_t N )
+{
+    uint32_t hash = 0x811c9dc5;
+    for ( size_t i = 0; i < N; i++ )
+        hash = ( hash ^ static_cast<uint8_t>( data[i] ) ) * 0x01000193;
+    return hash;
+}
+static void writeUint32( std::string &out, uint32_t x )
+{
+    for ( int i = 0; i < 4; i++ )
+        out += static_cast<char>( ( x >> ( 8 * i ) ) & 0xFF );
+}
+static uint32_t readUint32( const char *data )
+{
+    uint32_t x = 0;
+    for ( int i = 0; i < 4; i++ )
+        x |= static_cast<uint32_t>( static_cast<uint8_t>( data[i] ) ) << ( 8 * i );
+    return x;
+}
+static void writeVarint( std::string &out, uint64_t x )
+{
+    while ( x >= 0x80 ) {
+        out += static_cast<char>( ( x & 0x7F ) | 0x80 );
+        x >>= 7;
+    }
+    out += static_cast<char>( x );
+}
+static uint64_t readVarint( const char *&ptr, const char *end )
+{
+    uint64_t x = 0;
+    for ( int shift = 0; ptr < end && shift < 64; shift += 7 ) {
+        auto byte = static_cast<uint8_t>( *ptr++ );
+        x |= static_cast<uint64_t>( byte & 0x7F ) << shift;
+        if ( ( byte & 0x80 ) == 0 )
+            return x;
+    }
+    throw std::logic_error( "Corrupt profile record" );
+}
+
+
+/****************************************************************************
+ *  Encode a record                                                          *
+ ****************************************************************************/
+static std::string encodeRecord( const multi_stack_info &profile, int64_t t0, int64_t t1 )
+{
+    std::string payload;
+    writeVarint( payload, t0 );
+    writeVarint( payload, t1 );
+    auto data = profile.packCompact();
+    payload.append( data.data(), data.size() );
+    std::string record;
+    record.reserve( recordHeaderSize + payload.size() );
+    writeUint32( record, recordMagic );
+    writeUint32( record, static_cast<uint32_t>( payload.size() ) );
+    writeUint32( record, checksum( payload.data(), payload.size() ) );
+    return record + payload;
+}
+
+
+/****************************************************************************
+ *  Find the segments for a prefix (sorted by the index)                     *
+ ****************************************************************************/
+static std::string getSegmentName( const std::string &prefix, int index )
+{
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%06i.prof", index );
+    return prefix + suffix;
+}
+static std::vector<int> findSegments( const std::string &prefix )
+{
+    std::filesystem::path path( prefix );
+    auto dir  = path.parent_path().empty() ? std::filesystem::path( "." ) : path.parent_path();
+    auto stem = path.filename().string() + ".";
+    std::vector<int> segments;
+    std::error_code ec;
+    for ( const auto &entry : std::filesystem::directory_iterator( dir, ec ) ) {
+        auto name = entry.path().filename().string();
+        if ( name.size() != stem.size() + 11 || name.compare( 0, stem.size(), stem ) != 0 ||
+             name.compare( name.size() - 5, 5, ".prof" ) != 0 )
+            continue;
+        auto index = name.substr( stem.size(), 6 );
+        if ( std::all_of( index.begin(), index.end(), ::isdigit ) )
+            segments.push_back( std::stoi( index ) );
+    }
+    std::sort( segments.begin(), segments.end() );
+    return segments;
+}
+
+
+/****************************************************************************
+ *  Append records to the rotating segments                                  *
+ ****************************************************************************/
+namespace {
+class segmentWriter final
+{
+public:
+    segmentWriter( const std::string &prefix, size_t maxBytes, int maxSegments )
+        : d_prefix( prefix ),
+          d_maxBytes( maxBytes ),
+          d_maxSegments( std::max( maxSegments, 1 ) ),
+          d_segments( findSegments( prefix ) )
+    {
+    }
+    segmentWriter( const segmentWriter & )            = delete;
+    segmentWriter &operator=( const segmentWriter & ) = delete;
+    ~segmentWriter()
+    {
+        if ( d_fid )
+            fclose( d_fid );
+    }
+    void write( const std::string &record )
+    {
+        if ( d_fid && d_bytes > sizeof( segmentHeader ) && d_bytes + record.size() > d_maxBytes ) {
+            fclose( d_fid );
+            d_fid = nullptr;
+        }
+        if ( !d_fid )
+            open();
+        if ( !d_fid )
+            return;
+        fwrite( record.data(), 1, record.size(), d_fid );
+        fflush( d_fid );
+        d_bytes += record.size();
+    }
+
+private:
+    void open()
+    {
+        int index = d_segments.empty() ? 0 : d_segments.back() + 1;
+        d_fid     = fopen( getSegmentName( d_prefix, index ).data(), "wb" );
+        if ( !d_fid )
+            return;
+        fwrite( segmentHeader, 1, sizeof( segmentHeader ), d_fid );
+        d_bytes = sizeof( segmentHeader );
+        d_segments.push_back( index );
+        while ( static_cast<int>( d_segments.size() ) > d_maxSegments ) {
+            remove( getSegmentName( d_prefix, d_segments[0] ).data() );
+            d_segments.erase( d_segments.begin() );
+        }
+    }
+    std::string d_prefix;
+    size_t d_maxBytes;
+    int d_maxSegments;
+    std::vector<int> d_segments;
+    FILE *d_fid    = nullptr;
+    size_t d_bytes = 0;
+};
+} // namespace
+
+
+/****************************************************************************
+ *  Thread to record the profile                                             *
+ ****************************************************************************/
+static std::mutex recorderMutex;
+static std::mutex recorderWaitMutex;
+static std::condition_variable recorderWait;
+static std::shared_ptr<std::thread> recorderThread;
+static bool recorderRunning         = false;
+static bool recorderStartedProfiler = false;
+static int64_t getTime()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( now ).count();
+}
+static void runRecorderThread( std::string prefix, double interval, size_t maxBytes,
+                               int maxSegments )
+{
+    segmentWriter writer( prefix, maxBytes, maxSegments );
+    auto t0     = getTime();
+    auto period = std::chrono::duration<double>( interval );
+    bool done   = false;
+    while ( !done ) {
+        {
+            std::unique_lock<std::mutex> lock( recorderWaitMutex );
+            recorderWait.wait_for( lock, period, [] { return !recorderRunning; } );
+            done = !recorderRunning;
+        }
+        multi_stack_info profile;
+        if ( done && recorderStartedProfiler )
+            profile = StackTrace::Profiler::stop();
+        else
+            profile = StackTrace::Profiler::flush();
+        auto t1 = getTime();
+        if ( profile.N > 0 )
+            writer.write( encodeRecord( profile, t0, t1 ) );
+        t0 = t1;
+    }
+}
+void StackTrace::Profiler::startRecording( const std::string &prefix, double interval,
+                                           size_t maxSegmentBytes, int maxSegments )
+{
+    std::lock_guard<std::mutex> lock( recorderMutex );
+    if ( recorderThread || interval <= 0 )
+        return;
+    recorderStartedProfiler = !running();
+    if ( recorderStartedProfiler )
+        start();
+    recorderRunning = true;
+    recorderThread  = std::make_shared<std::thread>(
+        runRecorderThread, prefix, interval, maxSegmentBytes, maxSegments );
+}
+void StackTrace::Profiler::stopRecording()
+{
+    std::lock_guard<std::mutex> lock( recorderMutex );
+    if ( !recorderThread )
+        return;
+    {
+        std::lock_guard<std::mutex> lock2( recorderWaitMutex );
+        recorderRunning = false;
+    }
+    recorderWait.notify_all();
+    recorderThread->join();
+    recorderThread.reset();
+}
+
+
+/****************************************************************************
+ *  Read the records that overlap a time window                              *
+ *  Note: a truncated or corrupt record ends the segment (e.g. the process   *
+ *    was killed while writing)                                              *
+ ****************************************************************************/
+multi_stack_info StackTrace::Profiler::readRecording( const std::string &prefix,
+                                                      double startTime, double endTime )
+{
+    multi_stack_info profile;
+    std::string payload;
+    for ( int index : findSegments( prefix ) ) {
+        auto fid = fopen( getSegmentName( prefix, index ).data(), "rb" );
+        if ( !fid )
+            continue;
+        char header[sizeof( segmentHeader )];
+        bool valid = fread( header, 1, sizeof( header ), fid ) == sizeof( header ) &&
+                     memcmp( header, segmentHeader, sizeof( header ) ) == 0;
+        char recordHeader[recordHeaderSize];
+        while ( valid && fread( recordHeader, 1, recordHeaderSize, fid ) == recordHeaderSize ) {
+            payload.resize( readUint32( recordHeader + 4 ) );
+            valid = readUint32( recordHeader ) == recordMagic &&
+                    fread( payload.data(), 1, payload.size(), fid ) == payload.size() &&
+                    checksum( payload.data(), payload.size() ) == readUint32( recordHeader + 8 );
+            if ( !valid )
+                break;
+            const char *ptr = payload.data();
+            const char *end = ptr + payload.size();
+            try {
+                double t0 = 1e-9 * readVarint( ptr, end );
+                double t1 = 1e-9 * readVarint( ptr, end );
+                if ( t1 >= startTime && t0 <= endTime && ptr < end )
+                    StackTrace::packed_stack_view( ptr, end - ptr ).addTo( profile );
+            } catch ( ... ) {
+                valid = false;
+            }
+        }
+        fclose( fid );
+    }
+    return profile;
+}
@@ -0,0 +1,826 @@
+#include "StackTrace/Structured.h"
+#include "StackTrace/Internal.h"
+#include "StackTrace/StackTrace.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+using StackTrace::abort_error;
+using StackTrace::multi_stack_info;
+using StackTrace::stack_info;
+using StackTrace::structuredFormat;
+using StackTrace::structuredReader;
+using StackTrace::structuredWriter;
+using StackTrace::Internal::hasFrame;
+
+
+/****************************************************************************
+ *  Helper functions                                                         *
+ ****************************************************************************/
+static constexpr const char *terminateNames[] = { "signal", "exception", "abort", "MPI",
+                                                  "unknown" };
+static constexpr const char *stackTypeNames[] = { "none", "local", "threaded", "global" };
+template<size_t N>
+static inline std::string_view getField( const std::array<char, N> &field )
+{
+    return std::string_view( field.data(), strnlen( field.data(), N ) );
+}
+[[noreturn]] static void corrupt() { throw std::logic_error( "Corrupt structured data" ); }
+
+
+/****************************************************************************
+ *  JSON output                                                              *
+ *  Note: a comma is needed before the next key/value unless a container     *
+ *    or key was just written, so no stack of the nesting is needed          *
+ ****************************************************************************/
+namespace {
+class jsonWriter final
+{
+public:
+    explicit jsonWriter( std::string &out ) : d_out( out ) {}
+    void beginObject( size_t )
+    {
+        comma();
+        d_out += '{';
+        d_comma = false;
+    }
+    void endObject()
+    {
+        d_out += '}';
+        d_comma = true;
+    }
+    void beginArray( size_t )
+    {
+        comma();
+        d_out += '[';
+        d_comma = false;
+    }
+    void endArray()
+    {
+        d_out += ']';
+        d_comma = true;
+    }
+    void key( const char *name )
+    {
+        comma();
+        d_out += '"';
+        d_out += name;
+        d_out += "\":";
+        d_comma = false;
+    }
+    void value( int64_t x )
+    {
+        comma();
+        char buf[32];
+        auto result = std::to_chars( buf, buf + sizeof( buf ), x );
+        d_out.append( buf, result.ptr );
+        d_comma = true;
+    }
+    void address( const void *ptr )
+    {
+        comma();
+        char buf[32] = { '"', '0', 'x' };
+        auto result  = std::to_chars( buf + 3, buf + sizeof( buf ) - 1,
+                                     reinterpret_cast<uintptr_t>( ptr ), 16 );
+        *result.ptr  = '"';
+        d_out.append( buf, result.ptr + 1 );
+        d_comma = true;
+    }
+    void value( std::string_view str )
+    {
+        comma();
+        d_out += '"';
+        size_t i0 = 0;
+        for ( size_t i = 0; i < str.size(); i++ ) {
+            auto c = static_cast<uint8_t>( str[i] );
+            if ( c >= 0x20 && c != '"' && c != '\\' )
+                continue;
+            d_out.append( str.data() + i0, i - i0 );
+            i0 = i + 1;
+            if ( c == '"' || c == '\\' ) {
+                d_out += '\\';
+                d_out += c;
+            } else if ( c == '\n' ) {
+                d_out += "\\n";
+            } else if ( c == '\t' ) {
+                d_out += "\\t";
+            } else if ( c == '\r' ) {
+                d_out += "\\r";
+            } else {
+                char buf[8];
+                snprintf( buf, sizeof( buf ), "\\u%04x", c );
+                d_out += buf;
+            }
+        }
+        d_out.append( str.data() + i0, str.size() - i0 );
+        d_out += '"';
+        d_comma = true;
+    }
+    void end() { d_out += '\n'; }
+
+private:
+    void comma()
+    {
+        if ( d_comma )
+            d_out += ',';
+    }
+    std::string &d_out;
+    bool d_comma = false;
+};
+} // namespace
+
+
+/****************************************************************************
+ *  CBOR output                                                              *
+ ****************************************************************************/
+namespace {
+class cborWriter final
+{
+public:
+    explicit cborWriter( std::string &out ) : d_out( out ) {}
+    void beginObject( size_t N ) { head( 5, N ); }
+    void endObject() {}
+    void beginArray( size_t N ) { head( 4, N ); }
+    void endArray() {}
+    void key( const char *name ) { value( std::string_view( name ) ); }
+    void value( int64_t x )
+    {
+        if ( x >= 0 )
+            head( 0, x );
+        else
+            head( 1, -( x + 1 ) );
+    }
+    void address( const void *ptr ) { head( 0, reinterpret_cast<uintptr_t>( ptr ) ); }
+    void value( std::string_view str )
+    {
+        head( 3, str.size() );
+        d_out.append( str.data(), str.size() );
+    }
+    void end() {}
+
+private:
+    void head( uint8_t major, uint64_t x )
+    {
+        char buf[9];
+        int N = 0;
+        if ( x < 24 ) {
+            buf[0] = static_cast<char>( ( major << 5 ) | x );
+        } else {
+            int bytes = x <= 0xFF ? 1 : ( x <= 0xFFFF ? 2 : ( x <= 0xFFFFFFFF ? 4 : 8 ) );
+            int info  = bytes == 1 ? 24 : ( bytes == 2 ? 25 : ( bytes == 4 ? 26 : 27 ) );
+            buf[0]    = static_cast<char>( ( major << 5 ) | info );
+            for ( int i = 0; i < bytes; i++ )
+                buf[bytes - i] = static_cast<char>( ( x >> ( 8 * i ) ) & 0xFF );
+            N = bytes;
+        }
+        d_out.append( buf, N + 1 );
+    }
+    std::string &d_out;
+};
+} // namespace
+
+
+/****************************************************************************
+ *  Write the data                                                           *
+ ****************************************************************************/
+template<class WRITER>
+static void writeFrame( WRITER &out, const stack_info &frame )
+{
+    std::string_view fields[] = { getField( frame.object ), getField( frame.objectPath ),
+                                  getField( frame.filename ), getField( frame.filenamePath ),
+                                  getField( frame.function ) };
+    const char *names[]       = { "object", "objectPath", "filename", "filenamePath",
+                                  "function" };
+    size_t N                  = 1 + ( frame.address2 != frame.address ) + ( frame.line != 0 );
+    for ( auto field : fields )
+        N += !field.empty();
+    out.beginObject( N );
+    out.key( "address" );
+    out.address( frame.address );
+    if ( frame.address2 != frame.address ) {
+        out.key( "address2" );
+        out.address( frame.address2 );
+    }
+    if ( frame.line != 0 ) {
+        out.key( "line" );
+        out.value( static_cast<int64_t>( frame.line ) );
+    }
+    for ( size_t i = 0; i < 5; i++ ) {
+        if ( !fields[i].empty() ) {
+            out.key( names[i] );
+            out.value( fields[i] );
+        }
+    }
+    out.endObject();
+}
+template<class WRITER>
+static void writeFrames( WRITER &out, const std::vector<stack_info> &stack )
+{
+    out.beginArray( stack.size() );
+    for ( const auto &frame : stack )
+        writeFrame( out, frame );
+    out.endArray();
+}
+template<class WRITER, class FLUSH>
+static void writeTree( WRITER &out, const multi_stack_info &stack, const FLUSH &flush )
+{
+    bool frame = hasFrame( stack.stack );
+    out.beginObject( 1 + frame + !stack.children.empty() );
+    out.key( "N" );
+    out.value( stack.N );
+    if ( frame ) {
+        out.key( "frame" );
+        writeFrame( out, stack.stack );
+    }
+    flush();
+    if ( !stack.children.empty() ) {
+        out.key( "children" );
+        out.beginArray( stack.children.size() );
+        for ( const auto &child : stack.children )
+            writeTree( out, child, flush );
+        out.endArray();
+    }
+    out.endObject();
+}
+template<class WRITER>
+static void writeError( WRITER &out, const abort_error &err )
+{
+    bool source = !err.source.empty();
+    out.beginObject( 6 + source );
+    out.key( "message" );
+    out.value( err.message );
+    out.key( "type" );
+    out.value( std::string_view( terminateNames[static_cast<int>( err.type ) % 5] ) );
+    out.key( "stackType" );
+    out.value( std::string_view( stackTypeNames[static_cast<int>( err.stackType ) % 4] ) );
+    out.key( "signal" );
+    out.value( static_cast<int64_t>( err.signal ) );
+    out.key( "bytes" );
+    out.value( static_cast<int64_t>( err.bytes ) );
+    if ( source ) {
+        out.key( "source" );
+        out.beginObject( 4 );
+        out.key( "file" );
+        out.value( std::string_view( err.source.file_name() ) );
+        out.key( "function" );
+        out.value( std::string_view( err.source.function_name() ) );
+        out.key( "line" );
+        out.value( static_cast<int64_t>( err.source.line() ) );
+        out.key( "column" );
+        out.value( static_cast<int64_t>( err.source.column() ) );
+        out.endObject();
+    }
+    out.key( "stack" );
+    writeFrames( out, StackTrace::getStackInfo( err.stack ) );
+    out.endObject();
+}
+
+
+/****************************************************************************
+ *  structuredWriter                                                         *
+ ****************************************************************************/
+structuredWriter::structuredWriter( structuredFormat format, size_t bufferSize )
+    : d_format( format ), d_out( nullptr ), d_bufferSize( bufferSize )
+{
+    d_buffer.reserve( bufferSize );
+}
+structuredWriter::structuredWriter( std::ostream &out, structuredFormat format,
+                                    size_t bufferSize )
+    : d_format( format ), d_out( &out ), d_bufferSize( bufferSize )
+{
+    d_buffer.reserve( bufferSize );
+}
+structuredWriter::~structuredWriter() { flush(); }
+void structuredWriter::flush()
+{
+    if ( !d_out || d_buffer.empty() )
+        return;
+    d_out->write( d_buffer.data(), d_buffer.size() );
+    d_out->flush();
+    d_buffer.clear();
+}
+template<class FUN>
+void structuredWriter::write2( const FUN &fun )
+{
+    // Write the buffer to the stream when it is (almost) full
+    auto flush = [this]() {
+        if ( d_out && d_buffer.size() + 1024 > d_bufferSize ) {
+            d_out->write( d_buffer.data(), d_buffer.size() );
+            d_buffer.clear();
+        }
+    };
+    if ( d_format == structuredFormat::JSON ) {
+        jsonWriter out( d_buffer );
+        fun( out, flush );
+        out.end();
+    } else {
+        cborWriter out( d_buffer );
+        fun( out, flush );
+        out.end();
+    }
+    flush();
+}
+void structuredWriter::write( const stack_info &frame )
+{
+    write2( [&frame]( auto &out, auto & ) { writeFrame( out, frame ); } );
+}
+void structuredWriter::write( const std::vector<stack_info> &stack )
+{
+    write2( [&stack]( auto &out, auto & ) { writeFrames( out, stack ); } );
+}
+void structuredWriter::write( const multi_stack_info &stack )
+{
+    write2( [&stack]( auto &out, auto &flush ) { writeTree( out, stack, flush ); } );
+}
+void structuredWriter::write( const abort_error &err )
+{
+    write2( [&err]( auto &out, auto & ) { writeError( out, err ); } );
+}
+
+
+/****************************************************************************
+ *  JSON input                                                               *
+ ****************************************************************************/
+namespace {
+class jsonReader final
+{
+public:
+    jsonReader( const char *ptr, const char *end ) : d_ptr( ptr ), d_end( end ) {}
+    const char *position() const { return d_ptr; }
+    void beginObject()
+    {
+        expect( '{' );
+        d_first = true;
+    }
+    bool nextKey( std::string_view &key )
+    {
+        if ( !next( '}' ) )
+            return false;
+        key = readString();
+        expect( ':' );
+        return true;
+    }
+    void beginArray()
+    {
+        expect( '[' );
+        d_first = true;
+    }
+    bool nextItem() { return next( ']' ); }
+    int64_t readInt()
+    {
+        skipSpace();
+        int64_t x   = 0;
+        auto result = std::from_chars( d_ptr, d_end, x );
+        if ( result.ec != std::errc() )
+            corrupt();
+        d_ptr = result.ptr;
+        return x;
+    }
+    void *readAddress()
+    {
+        auto str = readString();
+        if ( str.size() < 3 || str[0] != '0' || str[1] != 'x' )
+            corrupt();
+        uintptr_t x = 0;
+        auto result = std::from_chars( str.data() + 2, str.data() + str.size(), x, 16 );
+        if ( result.ec != std::errc() )
+            corrupt();
+        return reinterpret_cast<void *>( x );
+    }
+    std::string_view readString()
+    {
+        expect( '"' );
+        // Return the string in place if it does not contain escapes
+        const char *p0 = d_ptr;
+        const char *p1 = static_cast<const char *>( memchr( p0, '"', d_end - p0 ) );
+        if ( !p1 )
+            corrupt();
+        if ( !memchr( p0, '\\', p1 - p0 ) ) {
+            d_ptr = p1 + 1;
+            return std::string_view( p0, p1 - p0 );
+        }
+        d_string.clear();
+        while ( true ) {
+            if ( d_ptr >= d_end )
+                corrupt();
+            char c = *d_ptr++;
+            if ( c == '"' )
+                break;
+            if ( c != '\\' ) {
+                d_string += c;
+                continue;
+            }
+            if ( d_ptr >= d_end )
+                corrupt();
+            c = *d_ptr++;
+            if ( c == 'n' )
+                d_string += '\n';
+            else if ( c == 't' )
+                d_string += '\t';
+            else if ( c == 'r' )
+                d_string += '\r';
+            else if ( c == 'b' )
+                d_string += '\b';
+            else if ( c == 'f' )
+                d_string += '\f';
+            else if ( c == 'u' )
+                readUnicode();
+            else
+                d_string += c;
+        }
+        return d_string;
+    }
+    void skip()
+    {
+        skipSpace();
+        char c = d_ptr < d_end ? *d_ptr : 0;
+        if ( c == '{' ) {
+            beginObject();
+            std::string_view key;
+            while ( nextKey( key ) )
+                skip();
+        } else if ( c == '[' ) {
+            beginArray();
+            while ( nextItem() )
+                skip();
+        } else if ( c == '"' ) {
+            readString();
+        } else if ( c != 0 ) {
+            // Number or literal
+            const char *p0 = d_ptr;
+            while ( d_ptr < d_end && ( isalnum( *d_ptr ) || strchr( "+-.", *d_ptr ) ) )
+                d_ptr++;
+            if ( d_ptr == p0 )
+                corrupt();
+        } else {
+            corrupt();
+        }
+        d_first = false;
+    }
+    bool empty()
+    {
+        skipSpace();
+        return d_ptr == d_end;
+    }
+
+private:
+    void skipSpace()
+    {
+        while ( d_ptr < d_end && ( *d_ptr == ' ' || *d_ptr == '\n' || *d_ptr == '\r' ||
+                                   *d_ptr == '\t' ) )
+            d_ptr++;
+    }
+    void expect( char c )
+    {
+        skipSpace();
+        if ( d_ptr >= d_end || *d_ptr != c )
+            corrupt();
+        d_ptr++;
+    }
+    // Check for the next item in a container (consuming the separator or the end)
+    bool next( char close )
+    {
+        skipSpace();
+        if ( d_ptr < d_end && *d_ptr == close ) {
+            d_ptr++;
+            d_first = false;
+            return false;
+        }
+        if ( !d_first )
+            expect( ',' );
+        d_first = false;
+        return true;
+    }
+    uint32_t readHex()
+    {
+        uint32_t x  = 0;
+        auto result = std::from_chars( d_ptr, std::min( d_ptr + 4, d_end ), x, 16 );
+        if ( result.ptr != d_ptr + 4 )
+            corrupt();
+        d_ptr += 4;
+        return x;
+    }
+    void readUnicode()
+    {
+        uint32_t x = readHex();
+        if ( x >= 0xD800 && x < 0xDC00 && d_end - d_ptr >= 6 && d_ptr[0] == '\\' &&
+             d_ptr[1] == 'u' ) {
+            d_ptr += 2;
+            x = 0x10000 + ( ( x - 0xD800 ) << 10 ) + ( readHex() - 0xDC00 );
+        }
+        // Encode as UTF-8
+        if ( x < 0x80 ) {
+            d_string += static_cast<char>( x );
+        } else if ( x < 0x800 ) {
+            d_string += static_cast<char>( 0xC0 | ( x >> 6 ) );
+            d_string += static_cast<char>( 0x80 | ( x & 0x3F ) );
+        } else if ( x < 0x10000 ) {
+            d_string += static_cast<char>( 0xE0 | ( x >> 12 ) );
+            d_string += static_cast<char>( 0x80 | ( ( x >> 6 ) & 0x3F ) );
+            d_string += static_cast<char>( 0x80 | ( x & 0x3F ) );
+        } else {
+            d_string += static_cast<char>( 0xF0 | ( x >> 18 ) );
+            d_string += static_cast<char>( 0x80 | ( ( x >> 12 ) & 0x3F ) );
+            d_string += static_cast<char>( 0x80 | ( ( x >> 6 ) & 0x3F ) );
+            d_string += static_cast<char>( 0x80 | ( x & 0x3F ) );
+        }
+    }
+    const char *d_ptr;
+    const char *d_end;
+    bool d_first = true;
+    std::string d_string;
+};
+} // namespace
+
+
+/****************************************************************************
+ *  CBOR input                                                               *
+ ****************************************************************************/
+namespace {
+class cborReader final
+{
+public:
+    cborReader( const char *ptr, const char *end ) : d_ptr( ptr ), d_end( end ) {}
+    const char *position() const { return d_ptr; }
+    void beginObject()
+    {
+        auto N = head( 5 );
+        d_count.push_back( N );
+    }
+    bool nextKey( std::string_view &key )
+    {
+        if ( !next() )
+            return false;
+        key = readString();
+        return true;
+    }
+    void beginArray()
+    {
+        auto N = head( 4 );
+        d_count.push_back( N );
+    }
+    bool nextItem() { return next(); }
+    int64_t readInt()
+    {
+        uint8_t major = peek();
+        if ( major == 1 )
+            return -1 - static_cast<int64_t>( head( 1 ) );
+        return head( 0 );
+    }
+    void *readAddress() { return reinterpret_cast<void *>( head( 0 ) ); }
+    std::string_view readString()
+    {
+        auto N = head( 3 );
+        if ( N > static_cast<uint64_t>( d_end - d_ptr ) )
+            corrupt();
+        std::string_view str( d_ptr, N );
+        d_ptr += N;
+        return str;
+    }
+    void skip()
+    {
+        uint8_t major = peek();
+        if ( major == 4 || major == 5 ) {
+            uint64_t N = major == 5 ? 2 * head( 5 ) : head( 4 );
+            for ( uint64_t i = 0; i < N; i++ )
+                skip();
+        } else if ( major == 2 || major == 3 ) {
+            auto N = head( major );
+            if ( N > static_cast<uint64_t>( d_end - d_ptr ) )
+                corrupt();
+            d_ptr += N;
+        } else if ( major == 6 ) {
+            head( 6 );
+            skip();
+        } else {
+            head( major );
+        }
+    }
+    bool empty() { return d_ptr == d_end; }
+
+private:
+    uint8_t peek() const
+    {
+        if ( d_ptr >= d_end )
+            corrupt();
+        return static_cast<uint8_t>( *d_ptr ) >> 5;
+    }
+    uint64_t head( uint8_t major )
+    {
+        if ( peek() != major )
+            corrupt();
+        uint8_t info = static_cast<uint8_t>( *d_ptr++ ) & 0x1F;
+        if ( info < 24 )
+            return info;
+        if ( info > 27 )
+            corrupt();
+        int bytes = 1 << ( info - 24 );
+        if ( d_end - d_ptr < bytes )
+            corrupt();
+        uint64_t x = 0;
+        for ( int i = 0; i < bytes; i++ )
+            x = ( x << 8 ) | static_cast<uint8_t>( *d_ptr++ );
+        return x;
+    }
+    bool next()
+    {
+        if ( d_count.empty() )
+            corrupt();
+        if ( d_count.back() == 0 ) {
+            d_count.pop_back();
+            return false;
+        }
+        d_count.back()--;
+        return true;
+    }
+    const char *d_ptr;
+    const char *d_end;
+    std::vector<uint64_t> d_count;
+};
+} // namespace
+
+
+/****************************************************************************
+ *  Read the data                                                            *
+ ****************************************************************************/
+template<size_t N>
+static void copyField( std::string_view str, std::array<char, N> &field )
+{
+    size_t N2 = std::min( str.size(), N - 1 );
+    memcpy( field.data(), str.data(), N2 );
+    memset( &field[N2], 0, N - N2 );
+}
+template<class READER>
+static void readFrame( READER &in, stack_info &frame )
+{
+    frame.clear();
+    bool address2 = false;
+    std::string_view key;
+    in.beginObject();
+    while ( in.nextKey( key ) ) {
+        if ( key == "address" ) {
+            frame.address = in.readAddress();
+        } else if ( key == "address2" ) {
+            frame.address2 = in.readAddress();
+            address2       = true;
+        } else if ( key == "line" ) {
+            frame.line = in.readInt();
+        } else if ( key == "object" ) {
+            copyField( in.readString(), frame.object );
+        } else if ( key == "objectPath" ) {
+            copyField( in.readString(), frame.objectPath );
+        } else if ( key == "filename" ) {
+            copyField( in.readString(), frame.filename );
+        } else if ( key == "filenamePath" ) {
+            copyField( in.readString(), frame.filenamePath );
+        } else if ( key == "function" ) {
+            copyField( in.readString(), frame.function );
+        } else {
+            in.skip();
+        }
+    }
+    if ( !address2 )
+        frame.address2 = frame.address;
+}
+template<class READER>
+static void readFrames( READER &in, std::vector<stack_info> &stack )
+{
+    stack.clear();
+    in.beginArray();
+    while ( in.nextItem() ) {
+        stack.emplace_back();
+        readFrame( in, stack.back() );
+    }
+}
+template<class READER>
+static void readTree( READER &in, multi_stack_info &stack )
+{
+    stack.clear();
+    std::string_view key;
+    in.beginObject();
+    while ( in.nextKey( key ) ) {
+        if ( key == "N" ) {
+            stack.N = in.readInt();
+        } else if ( key == "frame" ) {
+            readFrame( in, stack.stack );
+        } else if ( key == "children" ) {
+            in.beginArray();
+            while ( in.nextItem() ) {
+                stack.children.emplace_back();
+                readTree( in, stack.children.back() );
+            }
+        } else {
+            in.skip();
+        }
+    }
+}
+template<class READER>
+static void readError( READER &in, abort_error &err, std::deque<std::string> &strings )
+{
+    auto find = []( std::string_view str, const char *const *names, int N ) {
+        for ( int i = 0; i < N; i++ ) {
+            if ( str == names[i] )
+                return i;
+        }
+        return -1;
+    };
+    err = abort_error();
+    std::string_view key;
+    in.beginObject();
+    while ( in.nextKey( key ) ) {
+        if ( key == "message" ) {
+            err.message = in.readString();
+        } else if ( key == "type" ) {
+            int i    = find( in.readString(), terminateNames, 5 );
+            err.type = static_cast<StackTrace::terminateType>( i == -1 ? 4 : i );
+        } else if ( key == "stackType" ) {
+            int i         = find( in.readString(), stackTypeNames, 4 );
+            err.stackType = static_cast<StackTrace::printStackType>( i == -1 ? 1 : i );
+        } else if ( key == "signal" ) {
+            err.signal = in.readInt();
+        } else if ( key == "bytes" ) {
+            err.bytes = in.readInt();
+        } else if ( key == "source" ) {
+            const char *file = "", *function = "";
+            uint32_t line = 0, column = 0;
+            in.beginObject();
+            while ( in.nextKey( key ) ) {
+                if ( key == "file" ) {
+                    file = strings.emplace_back( in.readString() ).data();
+                } else if ( key == "function" ) {
+                    function = strings.emplace_back( in.readString() ).data();
+                } else if ( key == "line" ) {
+                    line = in.readInt();
+                } else if ( key == "column" ) {
+                    column = in.readInt();
+                } else {
+                    in.skip();
+                }
+            }
+            err.source = StackTrace::source_location( file, function, line, column );
+        } else if ( key == "stack" ) {
+            std::vector<stack_info> stack;
+            readFrames( in, stack );
+            err.stack.resize( stack.size() );
+            for ( size_t i = 0; i < stack.size(); i++ )
+                err.stack[i] = stack[i].address;
+        } else {
+            in.skip();
+        }
+    }
+}
+
+
+/****************************************************************************
+ *  structuredReader                                                         *
+ ****************************************************************************/
+structuredReader::structuredReader( const char *data, size_t N, structuredFormat format )
+    : d_format( format ), d_ptr( data ), d_end( data + N )
+{
+}
+bool structuredReader::empty() const
+{
+    if ( d_format == structuredFormat::JSON )
+        return jsonReader( d_ptr, d_end ).empty();
+    return d_ptr == d_end;
+}
+template<class FUN>
+void structuredReader::read2( const FUN &fun )
+{
+    if ( d_format == structuredFormat::JSON ) {
+        jsonReader in( d_ptr, d_end );
+        fun( in );
+        d_ptr = in.position();
+    } else {
+        cborReader in( d_ptr, d_end );
+        fun( in );
+        d_ptr = in.position();
+    }
+}
+void structuredReader::read( stack_info &frame )
+{
+    read2( [&frame]( auto &in ) { readFrame( in, frame ); } );
+}
+void structuredReader::read( std::vector<stack_info> &stack )
+{
+    read2( [&stack]( auto &in ) { readFrames( in, stack ); } );
+}
+void structuredReader::read( multi_stack_info &stack )
+{
+    read2( [&stack]( auto &in ) { readTree( in, stack ); } );
+}
+void structuredReader::read( abort_error &err )
+{
+    read2( [this, &err]( auto &in ) { readError( in, err, d_strings ); } );
+}
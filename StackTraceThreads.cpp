@@ -3,7 +3,13 @@
 #include "StackTrace/Utilities.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <ctime>
+#include <fstream>
+#include <memory>
 #include <mutex>
 #include <thread>
 
@@ -246,4 +252,133 @@ std::vector<std::thread::native_handle_type> registeredThreads()
 }
 
 
+/****************************************************************************
+ *  Thread heartbeats                                                        *
+ *  Note: a count of zero indicates the thread is idle                       *
+ ****************************************************************************/
+struct heartbeatSlot {
+    std::atomic<uint64_t> count;
+    std::atomic<bool> used;
+};
+static heartbeatSlot heartbeatSlots[1024];
+thread_local struct HeartbeatHolder {
+    heartbeatSlot *slot = nullptr;
+    uint64_t count      = 0;
+    ~HeartbeatHolder()
+    {
+        if ( slot ) {
+            slot->count.store( 0 );
+            slot->used.store( false );
+        }
+    }
+} heartbeatHolder;
+static heartbeatSlot *getHeartbeatSlot()
+{
+    for ( auto &slot : heartbeatSlots ) {
+        bool used = false;
+        if ( slot.used.compare_exchange_strong( used, true ) )
+            return &slot;
+    }
+    return nullptr;
+}
+void heartbeat()
+{
+    auto &holder = heartbeatHolder;
+    if ( !holder.slot )
+        holder.slot = getHeartbeatSlot();
+    if ( holder.slot )
+        holder.slot->count.store( ++holder.count, std::memory_order_relaxed );
+}
+void heartbeatIdle()
+{
+    if ( heartbeatHolder.slot )
+        heartbeatHolder.slot->count.store( 0, std::memory_order_relaxed );
+}
+
+
+/****************************************************************************
+ *  Hang watchdog                                                            *
+ ****************************************************************************/
+static std::mutex watchdogMutex;
+static std::condition_variable watchdogCondition;
+static std::shared_ptr<std::thread> watchdogThread;
+static bool watchdogRunning = false;
+static void runWatchdog( double timeout, std::function<void( const multi_stack_info & )> callback,
+                         bool global )
+{
+    struct state_t {
+        uint64_t count = 0;
+        bool reported  = false;
+        std::chrono::steady_clock::time_point time;
+    };
+    std::vector<state_t> state( sizeof( heartbeatSlots ) / sizeof( heartbeatSlot ) );
+    auto wait = std::chrono::duration<double>( std::max( timeout / 4, 0.01 ) );
+    std::unique_lock<std::mutex> lock( watchdogMutex );
+    while ( !watchdogCondition.wait_for( lock, wait, [] { return !watchdogRunning; } ) ) {
+        auto now   = std::chrono::steady_clock::now();
+        bool stall = false;
+        for ( size_t i = 0; i < state.size(); i++ ) {
+            uint64_t count = heartbeatSlots[i].count.load( std::memory_order_relaxed );
+            if ( count == 0 || count != state[i].count ) {
+                state[i].count    = count;
+                state[i].time     = now;
+                state[i].reported = false;
+            } else if ( !state[i].reported &&
+                        std::chrono::duration<double>( now - state[i].time ).count() > timeout ) {
+                state[i].reported = true;
+                stall             = true;
+            }
+        }
+        if ( stall ) {
+            lock.unlock();
+            auto stack = global ? getGlobalCallStacks() : getAllCallStacks();
+            cleanupStackTrace( stack );
+            callback( stack );
+            lock.lock();
+        }
+    }
+}
+void startWatchdog( double timeout, std::function<void( const multi_stack_info & )> callback,
+                    bool global )
+{
+    stopWatchdog();
+    std::lock_guard<std::mutex> lock( watchdogMutex );
+    watchdogRunning = true;
+    watchdogThread  = std::make_shared<std::thread>( runWatchdog, timeout, callback, global );
+}
+void startWatchdog( double timeout, const std::string &filename, bool global )
+{
+    auto callback = [filename, timeout]( const multi_stack_info &stack ) {
+        // Note: ctime is not thread-safe
+        auto now = std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() );
+        struct tm time;
+#ifdef USE_WINDOWS
+        localtime_s( &time, &now );
+#else
+        localtime_r( &now, &time );
+#endif
+        char date[64];
+        strftime( date, sizeof( date ), "%a %b %e %H:%M:%S %Y", &time );
+        std::ofstream out( filename, std::ios::app );
+        out << "Watchdog: thread stalled for more than " << timeout << " s at " << date
+            << std::endl;
+        stack.print( out );
+        out << std::endl;
+    };
+    startWatchdog( timeout, callback, global );
+}
+void stopWatchdog()
+{
+    std::unique_lock<std::mutex> lock( watchdogMutex );
+    if ( !watchdogThread )
+        return;
+    watchdogRunning = false;
+    lock.unlock();
+    watchdogCondition.notify_all();
+    watchdogThread->join();
+    lock.lock();
+    watchdogThread.reset();
+}
+
+
 } // namespace StackTrace
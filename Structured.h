@@ -0,0 +1,125 @@
+#ifndef included_StackTrace_Structured
+#define included_StackTrace_Structured
+
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StackTrace/StackTrace.h"
+
+
+namespace StackTrace {
+
+
+//! Format of the structured data
+enum class structuredFormat : uint8_t {
+    JSON, //!< JSON (one value per line)
+    CBOR  //!< Binary (CBOR, RFC 8949)
+};
+
+
+/*!
+ * @brief  Writer for structured call stacks
+ * @details  This class writes stack_info, std::vector<stack_info>, multi_stack_info and
+ *    abort_error as JSON or CBOR so they can be ingested without parsing the printed
+ *    text.  Each call to write appends one value (JSON values are terminated by a
+ *    newline).  The fields are written directly into a buffer that is allocated once;
+ *    if the writer was created with a stream the buffer is written to the stream
+ *    whenever it is full.
+ *    Frames are objects with the fields address, address2 (if different), line,
+ *    object, objectPath, filename, filenamePath and function (empty fields are omitted).
+ *    Addresses are hex strings in JSON and unsigned integers in CBOR.
+ *    A multi_stack_info is an object with the fields N, frame and children.
+ *    An abort_error is an object with the fields message, type, stackType, signal,
+ *    bytes, source and stack (the resolved frames of the call stack).
+ */
+class structuredWriter final
+{
+public:
+    //! Write to an internal buffer (see data())
+    explicit structuredWriter( structuredFormat format, size_t bufferSize = 0x10000 );
+
+    //! Write to a stream
+    structuredWriter( std::ostream &out, structuredFormat format, size_t bufferSize = 0x10000 );
+
+    //! Destructor (flushes the buffer)
+    ~structuredWriter();
+
+    structuredWriter( const structuredWriter & )            = delete;
+    structuredWriter &operator=( const structuredWriter & ) = delete;
+
+    //! Write a frame
+    void write( const stack_info &frame );
+
+    //! Write a call stack
+    void write( const std::vector<stack_info> &stack );
+
+    //! Write a multi-stack
+    void write( const multi_stack_info &stack );
+
+    //! Write an error
+    void write( const abort_error &err );
+
+    //! Write any buffered data to the stream
+    void flush();
+
+    //! The buffered data (everything written if there is no stream)
+    std::string_view data() const { return d_buffer; }
+
+    //! Clear the buffered data
+    void clear() { d_buffer.clear(); }
+
+private:
+    template<class FUN>
+    void write2( const FUN &fun );
+    structuredFormat d_format;
+    std::ostream *d_out;
+    size_t d_bufferSize;
+    std::string d_buffer;
+};
+
+
+/*!
+ * @brief  Reader for structured call stacks
+ * @details  This class reads the values written by structuredWriter in order.
+ *    Unknown fields are ignored and missing fields keep their default values.
+ *    Corrupt data or a value of the wrong type throws std::logic_error.
+ *    The data must remain valid while the reader is used.
+ */
+class structuredReader final
+{
+public:
+    //! Create the reader
+    structuredReader( const char *data, size_t N, structuredFormat format );
+
+    //! Check if all values have been read
+    bool empty() const;
+
+    //! Read a frame
+    void read( stack_info &frame );
+
+    //! Read a call stack
+    void read( std::vector<stack_info> &stack );
+
+    //! Read a multi-stack
+    void read( multi_stack_info &stack );
+
+    //! Read an error (the source location strings are owned by the reader)
+    void read( abort_error &err );
+
+private:
+    template<class FUN>
+    void read2( const FUN &fun );
+    structuredFormat d_format;
+    const char *d_ptr;
+    const char *d_end;
+    std::deque<std::string> d_strings;
+};
+
+
+} // namespace StackTrace
+
+#endif
@@ -4,16 +4,28 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <vector>
 
 
 #include "StackTrace/ErrorHandlers.h"
+#include "StackTrace/FlatStack.h"
+#include "StackTrace/Profiler.h"
 #include "StackTrace/StackTrace.h"
+#include "StackTrace/Structured.h"
 #include "StackTrace/Utilities.h"
 
 
+#ifdef __linux__
+    #include <csignal>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+
 #ifdef USE_TIMER
     #include "MemoryApp.h"
     #include "ProfilerApp.h"
@@ -287,6 +299,33 @@ void testThreadStack( UnitTest &results, bool decoded_symbols )
 }
 
 
+// Test limiting the depth of the stack
+std::vector<void *> recursive_backtrace( int N, int maxDepth, int skip )
+{
+    if ( N > 0 )
+        return recursive_backtrace( N - 1, maxDepth, skip );
+    return StackTrace::backtrace( StackTrace::thisThread(), maxDepth, skip );
+}
+void testStackDepth( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    auto full  = recursive_backtrace( 100, 1000, 0 );
+    auto trace = recursive_backtrace( 100, 10, 3 );
+    bool pass  = trace.size() == 10 && full.size() >= 13;
+    for ( size_t i = 0; i < trace.size() && pass; i++ )
+        pass = trace[i] == full[i + 3];
+    auto stack = StackTrace::getCallStack( StackTrace::thisThread(), 2 );
+    pass       = pass && stack.size() == 2 && strstr( stack[0].function.data(), "testStackDepth" );
+    std::thread thread( sleep_ms, 500 );
+    sleep_ms( 50 ); // Give thread time to start
+    stack = StackTrace::getCallStack( thread.native_handle(), 3 );
+    thread.join();
+    pass = pass && stack.size() == 3 && !strstr( stack[0].function.data(), "signal_handler" );
+    addMessage( results, pass, "call stack depth" );
+}
+
+
 // Test stack trace of another thread
 void testFullStack( UnitTest & )
 {
@@ -343,6 +382,801 @@ void testGlobalStack( UnitTest &, bool all,
 }
 
 
+// Test stack trace of another process
+void testProcessStack( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+#ifdef __linux__
+    auto pid = fork();
+    if ( pid == 0 ) {
+        while ( true )
+            pause();
+    }
+    sleep_ms( 100 ); // Give the process time to start
+    double t1       = time();
+    auto call_stack = StackTrace::getProcessCallStacks( pid );
+    double t2       = time();
+    kill( pid, SIGKILL );
+    waitpid( pid, nullptr, 0 );
+    if ( call_stack.N == 1 && !call_stack.children.empty() ) {
+        std::cout << "Call stack (process):" << std::endl;
+        call_stack.print( std::cout );
+        std::cout << "Time to get call stack (process): " << t2 - t1 << std::endl;
+        std::cout << std::endl;
+        results.passes( "call stack (process)" );
+    } else {
+        results.expected( "call stack (process) requires permission to trace the process" );
+    }
+#else
+    NULL_USE( results );
+#endif
+}
+
+
+// Test the sampling profiler
+double profiler_busy_work( int N_ms )
+{
+    StackTrace::registerThread();
+    volatile double x = 0;
+    double t1         = time();
+    while ( time() - t1 < 1e-3 * N_ms ) {
+        for ( int i = 0; i < 10000; i++ )
+            x = x + std::sqrt( static_cast<double>( i ) );
+    }
+    return x;
+}
+int64_t countSamples( const StackTrace::multi_stack_info &stack, const char *function )
+{
+    if ( strstr( stack.stack.function.data(), function ) )
+        return stack.N;
+    int64_t N = 0;
+    for ( const auto &child : stack.children )
+        N += countSamples( child, function );
+    return N;
+}
+void testProfiler( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+#ifdef __linux__
+    // Sample in real time
+    StackTrace::Profiler::start( 1000 );
+    std::thread thread( profiler_busy_work, 500 );
+    thread.join();
+    auto profile = StackTrace::Profiler::stop();
+    cleanupStackTrace( profile );
+    bool pass = profile.N > 50 && countSamples( profile, "profiler_busy_work" ) > 0;
+    pass      = pass && !StackTrace::Profiler::running();
+    std::cout << "Profile:" << std::endl;
+    profile.print( std::cout );
+    std::cout << std::endl;
+    addMessage( results, pass, "profiler" );
+    // Sample the CPU time (the blocked thread should not be sampled)
+    StackTrace::Profiler::start( 1000, StackTrace::Profiler::sampleClock::cpu );
+    thread = std::thread( profiler_busy_work, 500 );
+    thread.join();
+    profile = StackTrace::Profiler::stop();
+    auto N  = countSamples( profile, "profiler_busy_work" );
+    pass    = profile.N > 50 && N > 0.9 * profile.N;
+    addMessage( results, pass, "profiler (cpu time)" );
+    // Sample the running and blocked threads
+    StackTrace::Profiler::startWallClock( 100 );
+    thread             = std::thread( profiler_busy_work, 500 );
+    std::thread thread2( sleep_ms, 500 );
+    thread.join();
+    thread2.join();
+    auto wallClock = StackTrace::Profiler::stopWallClock();
+    cleanupStackTrace( wallClock.running );
+    cleanupStackTrace( wallClock.blocked );
+    std::cout << "Wall-clock profile (running):" << std::endl;
+    wallClock.running.print( std::cout );
+    std::cout << "Wall-clock profile (blocked):" << std::endl;
+    wallClock.blocked.print( std::cout );
+    std::cout << std::endl;
+    pass = countSamples( wallClock.running, "profiler_busy_work" ) > 10;
+    pass = pass && countSamples( wallClock.blocked, "sleep_ms" ) > 10;
+    pass = pass && countSamples( wallClock.blocked, "nanosleep]" ) > 10;
+    addMessage( results, pass, "profiler (wall-clock)" );
+#else
+    NULL_USE( results );
+#endif
+}
+
+
+// Test the heap profiler
+void heap_profiler_allocate( std::vector<void *> &data, size_t bytes )
+{
+    for ( auto &ptr : data ) {
+        ptr = malloc( bytes );
+        memset( ptr, 0, bytes );
+    }
+}
+void testHeapProfiler( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+#if defined( USE_HEAP_PROFILER ) && defined( __linux__ ) && defined( __GLIBC__ )
+    StackTrace::Profiler::startHeap( 64 * 1024 );
+    std::vector<void *> data( 1000, nullptr );
+    heap_profiler_allocate( data, 50000 );
+    auto profile  = StackTrace::Profiler::getHeapProfile();
+    double bytes1 = countSamples( profile, "heap_profiler_allocate" );
+    for ( auto ptr : data )
+        free( ptr );
+    profile       = StackTrace::Profiler::getHeapProfile();
+    double bytes2 = countSamples( profile, "heap_profiler_allocate" );
+    StackTrace::Profiler::stopHeap();
+    std::cout << "Heap profile: " << bytes1 << " bytes (allocated), " << bytes2
+              << " bytes (freed)" << std::endl;
+    bool pass = std::abs( bytes1 - 5e7 ) < 1e7 && bytes2 == 0;
+    pass      = pass && StackTrace::Profiler::heapDroppedSamples() == 0;
+    addMessage( results, pass, "heap profiler" );
+#else
+    NULL_USE( results );
+#endif
+}
+
+
+// Test the hang watchdog
+void watchdog_stall( int N_ms )
+{
+    StackTrace::heartbeat();
+    sleep_ms( N_ms );
+    StackTrace::heartbeat();
+}
+void testWatchdog( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    int N_reports = 0;
+    StackTrace::multi_stack_info stack;
+    auto callback = [&N_reports, &stack]( const StackTrace::multi_stack_info &s ) {
+        N_reports++;
+        stack = s;
+    };
+    StackTrace::startWatchdog( 0.2, callback );
+    std::thread thread( watchdog_stall, 1000 );
+    for ( int i = 0; i < 20; i++ ) {
+        StackTrace::heartbeat();
+        sleep_ms( 20 );
+    }
+    StackTrace::heartbeatIdle();
+    thread.join();
+    StackTrace::stopWatchdog();
+    bool pass = N_reports == 1 && countSamples( stack, "watchdog_stall" ) == 1;
+    addMessage( results, pass, "watchdog" );
+}
+
+
+// Test recording the profile to disk
+void testRecording( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+#ifdef __linux__
+    auto prefix   = "TestStack_prof." + std::to_string( getpid() );
+    auto segments = [prefix]() {
+        std::vector<std::string> files;
+        for ( int i = 0; i < 100; i++ ) {
+            char filename[256];
+            snprintf( filename, sizeof( filename ), "%s.%06i.prof", prefix.data(), i );
+            if ( std::ifstream( filename ).good() )
+                files.push_back( filename );
+        }
+        return files;
+    };
+    StackTrace::Profiler::startRecording( prefix, 0.05, 2048, 3 );
+    std::thread thread( profiler_busy_work, 500 );
+    thread.join();
+    StackTrace::Profiler::stopRecording();
+    auto files   = segments();
+    auto profile = StackTrace::Profiler::readRecording( prefix );
+    auto empty   = StackTrace::Profiler::readRecording( prefix, 0, 1 );
+    cleanupStackTrace( profile );
+    bool pass = !files.empty() && files.size() <= 3 && !StackTrace::Profiler::running();
+    pass      = pass && profile.N > 0 && countSamples( profile, "profiler_busy_work" ) > 0;
+    pass      = pass && empty.N == 0;
+    for ( const auto &file : files )
+        remove( file.data() );
+    addMessage( results, pass, "profiler (recording)" );
+#else
+    NULL_USE( results );
+#endif
+}
+
+
+// Test the live stack dumps
+void testLiveDump( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+#ifdef __linux__
+    auto filename = "TestStack_dump." + std::to_string( getpid() );
+    auto readDump = [filename]( int N_ms ) {
+        std::string str;
+        for ( int i = 0; i < N_ms / 10 && str.find( "sleep_ms" ) == std::string::npos; i++ ) {
+            sleep_ms( 10 );
+            std::ifstream fid( filename );
+            str = std::string( std::istreambuf_iterator<char>( fid ), {} );
+        }
+        return str;
+    };
+    remove( filename.data() );
+    StackTrace::enableLiveDump( SIGUSR2, "TestStack_dump", "TestStack_dump.control" );
+    std::thread thread( sleep_ms, 3000 );
+    sleep_ms( 50 );
+    raise( SIGUSR2 );
+    auto dump1 = readDump( 1000 );
+    remove( filename.data() );
+    fclose( fopen( "TestStack_dump.control", "w" ) );
+    auto dump2 = readDump( 2000 );
+    thread.join();
+    StackTrace::disableLiveDump();
+    remove( filename.data() );
+    remove( "TestStack_dump.control" );
+    addMessage( results, dump1.find( "sleep_ms" ) != std::string::npos, "live dump (signal)" );
+    addMessage( results, dump2.find( "sleep_ms" ) != std::string::npos, "live dump (file)" );
+#else
+    NULL_USE( results );
+#endif
+}
+
+
+// Test the mutex contention profiler
+void contended_work( StackTrace::profiled_mutex &mutex, int N )
+{
+    for ( int i = 0; i < N; i++ ) {
+        std::lock_guard<StackTrace::profiled_mutex> lock( mutex );
+        auto t1 = time();
+        while ( time() - t1 < 1e-4 ) {}
+    }
+}
+void testMutexProfiler( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    StackTrace::profiled_mutex::reset();
+    StackTrace::profiled_mutex mutex;
+    std::vector<std::thread> threads;
+    for ( int i = 0; i < 4; i++ )
+        threads.emplace_back( contended_work, std::ref( mutex ), 100 );
+    for ( auto &thread : threads )
+        thread.join();
+    auto profile = StackTrace::profiled_mutex::report();
+    cleanupStackTrace( profile );
+    std::cout << "Mutex contention (ns):" << std::endl;
+    profile.print( std::cout );
+    std::cout << std::endl;
+    bool pass = profile.N > 0 && countSamples( profile, "contended_work" ) == profile.N;
+    addMessage( results, pass, "mutex contention profiler" );
+}
+
+
+// Test the difference between two stacks
+StackTrace::stack_info createFrame( size_t address, const char *function )
+{
+    StackTrace::stack_info frame;
+    frame.address  = reinterpret_cast<void *>( address );
+    frame.address2 = frame.address;
+    strcpy( frame.object.data(), "TestStack" );
+    strcpy( frame.function.data(), function );
+    return frame;
+}
+void testDiff( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    auto A = createFrame( 0x10, "A" );
+    auto B = createFrame( 0x20, "B" );
+    auto C = createFrame( 0x30, "C" );
+    auto D = createFrame( 0x40, "D" );
+    StackTrace::stack_info ABC[3] = { C, B, A }, ABD[3] = { D, B, A }, AC[2] = { C, A };
+    StackTrace::multi_stack_info a, b;
+    a.add( 3, ABC, 4 );
+    a.add( 2, AC, 2 );
+    a.N = 6;
+    b.add( 3, ABC, 1 );
+    b.add( 3, ABD, 3 );
+    b.N = 4;
+    auto diff = StackTrace::diff( a, b );
+    diff.print( std::cout );
+    std::stringstream folded;
+    diff.printFolded( folded );
+    std::cout << folded.str() << std::endl;
+    auto str  = folded.str();
+    bool pass = diff.N1 == 6 && diff.N2 == 4 && diff.children.size() == 1;
+    pass      = pass && str.find( "A;B;C 4 1\n" ) != std::string::npos;
+    pass      = pass && str.find( "A;B;D 0 3\n" ) != std::string::npos;
+    pass      = pass && str.find( "A;C 2 0\n" ) != std::string::npos;
+    addMessage( results, pass, "diff" );
+}
+
+
+// Test the hot functions/paths
+void testHotspots( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    auto A  = createFrame( 0x10, "A" );
+    auto B  = createFrame( 0x20, "B" );
+    auto B2 = createFrame( 0x24, "B" );
+    auto C  = createFrame( 0x30, "C" );
+    StackTrace::stack_info CBA[3] = { C, B, A }, BBA[3] = { B2, B, A }, CA[2] = { C, A };
+    StackTrace::multi_stack_info stack;
+    stack.add( 3, CBA, 4 );
+    stack.add( 3, BBA, 2 );
+    stack.add( 1, &A, 1 );
+    stack.add( 2, CA, 3 );
+    // Check the counts for the functions/objects
+    auto hot  = StackTrace::getHotspots( stack );
+    auto check = []( const StackTrace::hotspot_info &x, const char *name, int self, int total ) {
+        return strcmp( x.frame.function.data(), name ) == 0 && x.self == self && x.total == total;
+    };
+    bool pass = hot.total == 10 && hot.functions.size() == 3 && hot.objects.size() == 1;
+    pass      = pass && check( hot.functions[0], "C", 7, 7 );
+    pass      = pass && check( hot.functions[1], "B", 2, 6 );
+    pass      = pass && check( hot.functions[2], "A", 1, 10 );
+    pass      = pass && hot.objects[0].self == 10 && hot.objects[0].total == 10;
+    addMessage( results, pass, "getHotspots" );
+    // Check the hot paths
+    auto paths = StackTrace::getHotPaths( stack, 2 );
+    pass       = paths.size() == 2 && paths[0].N == 4 && paths[1].N == 3;
+    pass       = pass && paths[0].stack == std::vector<StackTrace::stack_info>( CBA, CBA + 3 );
+    pass       = pass && paths[1].stack == std::vector<StackTrace::stack_info>( CA, CA + 2 );
+    addMessage( results, pass, "getHotPaths" );
+    // Check collapsing the stack
+    StackTrace::stack_info BA[2] = { B, A };
+    StackTrace::multi_stack_info collapsed;
+    collapsed.add( 3, CBA, 4 );
+    collapsed.add( 2, BA, 2 );
+    collapsed.add( 1, &A, 1 );
+    collapsed.add( 2, CA, 3 );
+    pass = StackTrace::collapseByFunction( stack ).printString() == collapsed.printString();
+    // Indirect recursion (A->B->A) is merged into the first call of the function
+    auto A2 = createFrame( 0x14, "A" );
+    StackTrace::stack_info CABA[4] = { C, A2, B, A }, CBABA[5] = { C, B2, A2, B, A };
+    StackTrace::multi_stack_info recursive, folded;
+    recursive.add( 4, CABA, 2 );
+    recursive.add( 2, BA, 1 );
+    recursive.add( 5, CBABA, 3 );
+    folded.add( 3, CBA, 5 );
+    folded.add( 2, BA, 1 );
+    auto str = StackTrace::collapseByFunction( recursive ).printString();
+    pass     = pass && str == folded.printString();
+    addMessage( results, pass, "collapseByFunction" );
+}
+
+
+// Test adding stacks to wide nodes
+void testMultiStackAdd( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    auto root = createFrame( 0x10, "root" );
+    StackTrace::multi_stack_info stack;
+    for ( int it = 0; it < 2; it++ ) {
+        for ( size_t i = 0; i < 1000; i++ ) {
+            StackTrace::stack_info frames[2] = { createFrame( 0x1000 + 16 * i, "leaf" ), root };
+            stack.add( 2, frames );
+        }
+    }
+    // Frames with the same object and offset match (e.g. from different processes)
+    auto copy = stack;
+    auto leaf = createFrame( 0x100000, "leaf" );
+    leaf.address2                    = reinterpret_cast<void *>( 0x1000 + 16 * 500 );
+    StackTrace::stack_info frames[2] = { leaf, root };
+    copy.add( 2, frames, 3 );
+    copy.add( stack );
+    bool pass = stack.children.size() == 1 && stack.children[0].N == 2000;
+    pass      = pass && stack.children[0].children.size() == 1000;
+    pass      = pass && stack.children[0].children[999].N == 2;
+    pass      = pass && copy.children.size() == 1 && copy.children[0].children.size() == 1000;
+    pass      = pass && copy.children[0].children[500].N == 7;
+    // Reordering or swapping the children in place is detected by the index
+    auto &children = copy.children[0].children;
+    std::reverse( children.begin(), children.end() );
+    copy.add( 2, frames );
+    pass = pass && children.size() == 1000 && children[499].N == 8;
+    std::swap( children[499], children[0] );
+    copy.add( 2, frames );
+    pass = pass && children.size() == 1000 && children[0].N == 9;
+    // Unpacking in place (same number of children) must not use the old index
+    StackTrace::multi_stack_info other;
+    for ( size_t i = 0; i < 1000; i++ ) {
+        StackTrace::stack_info frames2[2] = { createFrame( 0x200000 + 16 * i, "leaf2" ), root };
+        other.add( 2, frames2 );
+    }
+    std::vector<char> data( other.size() );
+    other.pack( data.data() );
+    stack.unpack( data.data() );
+    StackTrace::stack_info frames2[2] = { createFrame( 0x200000 + 16 * 5, "leaf2" ), root };
+    stack.add( 2, frames2 );
+    pass = pass && stack.children[0].children.size() == 1000;
+    pass = pass && stack.children[0].children[5].N == 2;
+    addMessage( results, pass, "multi_stack_info::add (wide nodes)" );
+}
+
+
+// Test cleaning up a wide stack
+void testCleanup( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    // Each leaf is called through two internal frames that are removed by cleanup
+    auto root = createFrame( 0x10, "root()" );
+    StackTrace::multi_stack_info stack;
+    for ( size_t i = 0; i < 4000; i++ ) {
+        auto internal = createFrame( 0x100000 + 16 * i, "internal" );
+        strcpy( internal.filename.data(), "new_allocator.h" );
+        StackTrace::stack_info frames[3] = { createFrame( 0x1000 + 16 * ( i / 2 ), "leaf()" ),
+                                             internal, root };
+        stack.add( 3, frames );
+    }
+    auto t1 = time();
+    cleanupStackTrace( stack );
+    auto t2 = time();
+    printf( "Time to cleanup stack: %0.3f ms\n", 1e3 * ( t2 - t1 ) );
+    bool pass = stack.children.size() == 1 && stack.children[0].children.size() == 2000;
+    for ( const auto &child : stack.children[0].children )
+        pass = pass && child.N == 2 && child.children.empty();
+    addMessage( results, pass, "cleanupStackTrace (wide nodes)" );
+}
+
+
+// Test aggregating stacks in bounded memory
+bool checkCounts( const StackTrace::multi_stack_info &stack, int depth, int maxDepth )
+{
+    int64_t N  = 0;
+    bool valid = depth <= maxDepth + 1;
+    for ( const auto &child : stack.children ) {
+        N += child.N;
+        valid = valid && checkCounts( child, depth + 1, maxDepth );
+    }
+    return valid && ( stack.children.empty() || N <= stack.N );
+}
+void testBoundedStack( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    std::vector<StackTrace::stack_info> frames( 2000 );
+    for ( size_t i = 0; i < frames.size(); i++ )
+        frames[i] = createFrame( 0x10 * ( i + 1 ), ( "fun" + std::to_string( i ) ).data() );
+    // Add a hot path, a deep recursive path and many cold paths
+    StackTrace::bounded_stack_info bounded( 200, 1000000, 50 );
+    StackTrace::multi_stack_info stack;
+    uint64_t random = 1;
+    int64_t N       = 0;
+    bool pass       = true;
+    for ( int i = 0; i < 5000; i++ ) {
+        random = random * 6364136223846793005ull + 1442695040888963407ull;
+        std::vector<StackTrace::stack_info> path;
+        if ( i % 10 == 0 ) {
+            path = { frames[3], frames[2], frames[1], frames[0] };
+        } else if ( i == 1 ) {
+            path = frames;
+        } else {
+            for ( size_t j = 0; j < 2 + ( random >> 62 ); j++ )
+                path.push_back( frames[( random >> ( 10 * j ) ) % frames.size()] );
+        }
+        bounded.add( path.size(), path.data() );
+        stack.add( path.size(), path.data() );
+        N++;
+        pass = pass && bounded.numberOfNodes() <= 200;
+    }
+    stack.N = N;
+    pass    = pass && bounded.get().N == N && checkCounts( bounded.get(), 0, 50 );
+    pass    = pass && bounded.get().numberOfNodes() == bounded.numberOfNodes();
+    auto &hot = bounded.get().children;
+    pass = pass && !hot.empty() && hot[0].stack == frames[0] && hot[0].children[0].N == 500;
+    // Prune the full stack
+    size_t nodes = stack.numberOfNodes();
+    stack.prune( 100, 3 );
+    pass = pass && nodes > 1000 && stack.numberOfNodes() <= 100 && checkCounts( stack, 0, 3 );
+    pass = pass && stack.children[0].stack == frames[0] && stack.children[0].N >= 500;
+    int64_t N2 = 0;
+    for ( const auto &child : stack.children )
+        N2 += child.N;
+    pass = pass && N2 == N;
+    // Prune to fewer nodes than the root needs (all children are moved to [other])
+    StackTrace::multi_stack_info root;
+    root.N = 1;
+    root.prune( 0 );
+    stack.prune( 0 );
+    pass = pass && root.numberOfNodes() == 1 && stack.numberOfNodes() == 2;
+    pass = pass && stack.children[0].N == N;
+    // Bound the memory (including the arrays of children and their indices)
+    size_t maxBytes = 200 * sizeof( StackTrace::multi_stack_info );
+    StackTrace::bounded_stack_info bounded2( 1000000, maxBytes );
+    for ( int i = 0; i < 5000; i++ ) {
+        random = random * 6364136223846793005ull + 1442695040888963407ull;
+        std::vector<StackTrace::stack_info> path;
+        for ( size_t j = 0; j < 2 + ( random >> 62 ); j++ )
+            path.push_back( frames[( random >> ( 10 * j ) ) % frames.size()] );
+        bounded2.add( path.size(), path.data() );
+        pass = pass && bounded2.memoryUsage() <= maxBytes;
+    }
+    pass = pass && bounded2.memoryUsage() == bounded2.get().memoryUsage();
+    pass = pass && bounded2.get().N == 5000 && checkCounts( bounded2.get(), 0, 1000 );
+    addMessage( results, pass, "bounded_stack_info" );
+}
+
+
+// Test the flat representation of the stack
+void testFlatStack( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    auto A = createFrame( 0x10, "A" );
+    auto B = createFrame( 0x20, "B" );
+    auto C = createFrame( 0x30, "C" );
+    auto D = createFrame( 0x40, "D" );
+    StackTrace::stack_info ABC[3] = { C, B, A }, ABD[3] = { D, B, A }, AC[2] = { C, A };
+    StackTrace::multi_stack_info multi;
+    StackTrace::flat_stack_info flat;
+    for ( int i = 0; i < 3; i++ ) {
+        multi.add( 3, ABC, 4 );
+        multi.add( 3, ABD );
+        multi.add( 2, AC, 2 );
+        flat.add( 3, ABC, 4 );
+        flat.add( 3, ABD );
+        flat.add( 2, AC, 2 );
+    }
+    auto str1 = multi.printString();
+    auto str2 = flat.toMultiStack().printString();
+    auto str3 = StackTrace::flat_stack_info( multi ).toMultiStack().printString();
+    bool pass = str1 == str2 && str1 == str3 && flat.size() == 6 && flat.numberOfFrames() == 4;
+    multi.add( multi );
+    flat.add( flat );
+    pass = pass && multi.printString() == flat.toMultiStack().printString();
+    addMessage( results, pass, "flat_stack_info" );
+}
+
+
+// Test merging the stacks in parallel
+void testMergeStacks( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    std::vector<StackTrace::stack_info> frames( 64 );
+    for ( size_t i = 0; i < frames.size(); i++ )
+        frames[i] = createFrame( 0x10 * ( i + 1 ), ( "fun" + std::to_string( i ) ).data() );
+    std::vector<std::vector<StackTrace::stack_info>> stacks( 5000 );
+    uint64_t random = 1;
+    for ( auto &stack : stacks ) {
+        random = random * 6364136223846793005ull + 1442695040888963407ull;
+        stack.resize( 2 + ( random >> 61 ) );
+        for ( size_t j = 0; j < stack.size(); j++ )
+            stack[j] = frames[( random >> ( 4 * j ) ) % ( j + 4 )];
+    }
+    StackTrace::multi_stack_info serial;
+    serial.N = stacks.size();
+    for ( const auto &stack : stacks )
+        serial.add( stack.size(), stack.data() );
+    auto t1       = time();
+    auto parallel = StackTrace::mergeStacks( stacks, 8 );
+    auto t2       = time();
+    std::vector<StackTrace::multi_stack_info> partial( 10 );
+    for ( size_t i = 0; i < stacks.size(); i++ ) {
+        partial[i % 10].N++;
+        partial[i % 10].add( stacks[i].size(), stacks[i].data() );
+    }
+    StackTrace::multi_stack_info serial2;
+    for ( const auto &tmp : partial )
+        serial2.add( tmp );
+    auto parallel2 = StackTrace::mergeStacks( partial, 4 );
+    printf( "Time to merge %i stacks: %0.3f ms\n", static_cast<int>( stacks.size() ),
+            1e3 * ( t2 - t1 ) );
+    bool pass = serial.printString() == parallel.printString() && parallel.N == 5000;
+    pass      = pass && serial2.printString() == parallel2.printString();
+    addMessage( results, pass, "mergeStacks" );
+}
+
+
+// Test resolving the frames shared by the call stacks of several threads
+void checkFrames( const StackTrace::multi_stack_info &stack, bool &pass, int64_t &N )
+{
+    if ( stack.stack.address ) {
+        auto frame = StackTrace::getStackInfo( stack.stack.address );
+        pass       = pass && frame.address2 == stack.stack.address2;
+        pass       = pass && strcmp( frame.function.data(), stack.stack.function.data() ) == 0;
+        if ( strstr( stack.stack.function.data(), "sleep_ms" ) )
+            N = std::max( N, stack.N );
+    }
+    for ( const auto &child : stack.children )
+        checkFrames( child, pass, N );
+}
+void testGenerateStacks( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    // Each address is resolved once and must map to its own frame in every stack
+    std::thread thread1( sleep_ms, 200 ), thread2( sleep_ms, 200 ), thread3( sleep_ms, 200 );
+    sleep_ms( 20 );
+    auto stack = StackTrace::getAllCallStacks();
+    thread1.join();
+    thread2.join();
+    thread3.join();
+    bool pass = true;
+    int64_t N = 0;
+    checkFrames( stack, pass, N );
+    pass = pass && N >= 3;
+    addMessage( results, pass, "getAllCallStacks (shared frames)" );
+}
+
+
+// Test packing/unpacking the stack
+void testPack( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    std::thread thread( sleep_ms, 200 );
+    sleep_ms( 20 );
+    auto stack = StackTrace::getAllCallStacks();
+    thread.join();
+    std::vector<char> legacy( stack.size() );
+    stack.pack( legacy.data() );
+    auto compact = stack.packCompact();
+    StackTrace::multi_stack_info stack1, stack2;
+    auto end1 = stack1.unpack( legacy.data(), legacy.size() );
+    auto end2 = stack2.unpack( compact.data(), compact.size() );
+    printf( "Packed size: %i bytes (legacy), %i bytes (compact)\n",
+            static_cast<int>( legacy.size() ), static_cast<int>( compact.size() ) );
+    auto str  = stack.printString();
+    bool pass = str == stack1.printString() && str == stack2.printString();
+    pass      = pass && end1 == legacy.data() + legacy.size();
+    pass      = pass && end2 == compact.data() + compact.size();
+    pass      = pass && 5 * compact.size() < legacy.size();
+    // Counts larger than an int (e.g. byte weights) require the compact format
+    StackTrace::multi_stack_info large;
+    large.N = 0x300000001;
+    legacy.resize( large.size() );
+    try {
+        large.pack( legacy.data() );
+        pass = false;
+    } catch ( std::exception & ) {
+    }
+    auto data = large.packCompact();
+    stack1.unpack( data.data(), data.size() );
+    pass = pass && stack1.N == large.N;
+    addMessage( results, pass, "multi_stack_info::packCompact" );
+    // Use the packed data directly
+    StackTrace::packed_stack_view view( compact.data(), compact.size() );
+    StackTrace::multi_stack_info merged1, merged2;
+    merged1.add( stack );
+    merged1.add( stack );
+    view.addTo( merged2 );
+    view.addTo( merged2 );
+    int64_t N = 0;
+    view.visit( [&N]( int, int64_t, const StackTrace::packed_stack_view::frame *frame ) {
+        if ( frame && frame->function.find( "sleep_ms" ) != std::string_view::npos )
+            N++;
+    } );
+    auto merged3 = StackTrace::mergeStacks( std::vector<StackTrace::packed_stack_view>( 2, view ) );
+    pass = view.printString() == str && view.N() == stack.N && view.size() == compact.size();
+    pass = pass && merged1.printString() == merged2.printString();
+    pass = pass && merged1.printString() == merged3.printString() && N > 0;
+    // Check that truncated data is rejected
+    int N_rejected = 0;
+    for ( size_t bytes : { size_t( 0 ), size_t( 10 ), compact.size() - 1 } ) {
+        try {
+            StackTrace::packed_stack_view( compact.data(), bytes );
+        } catch ( std::exception & ) {
+            N_rejected++;
+        }
+    }
+    try {
+        stack1.unpack( legacy.data(), legacy.size() - 1 );
+    } catch ( std::exception & ) {
+        N_rejected++;
+    }
+    pass = pass && N_rejected == 4;
+    addMessage( results, pass, "packed_stack_view" );
+}
+
+
+// Test the structured output
+void testStructured( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    auto frame = createFrame( 0x1234, "fun(\"a\\b\"\n)" );
+    strcpy( frame.filename.data(), "test.cpp" );
+    frame.line  = 42;
+    auto stack  = StackTrace::getCallStack();
+    auto multi  = StackTrace::getAllCallStacks();
+    auto source = SOURCE_LOCATION_CURRENT();
+    StackTrace::abort_error err;
+    err.message = "test error";
+    err.type    = StackTrace::terminateType::signal;
+    err.signal  = 11;
+    err.source  = source;
+    err.stack   = { stack[0].address, stack[1].address };
+    using StackTrace::structuredFormat;
+    for ( auto format : { structuredFormat::JSON, structuredFormat::CBOR } ) {
+        auto name = format == structuredFormat::JSON ? "JSON" : "CBOR";
+        std::stringstream ss;
+        StackTrace::structuredWriter writer( format );
+        {
+            StackTrace::structuredWriter writer2( ss, format, 1024 );
+            for ( auto *w : { &writer, &writer2 } ) {
+                w->write( frame );
+                w->write( stack );
+                w->write( multi );
+                w->write( err );
+            }
+        }
+        auto data = writer.data();
+        bool pass = ss.str() == data;
+        try {
+            StackTrace::stack_info frame2;
+            std::vector<StackTrace::stack_info> stack2;
+            StackTrace::multi_stack_info multi2;
+            StackTrace::abort_error err2;
+            StackTrace::structuredReader reader( data.data(), data.size(), format );
+            reader.read( frame2 );
+            reader.read( stack2 );
+            reader.read( multi2 );
+            reader.read( err2 );
+            pass = pass && reader.empty();
+            pass = pass && frame2 == frame && frame2.line == 42;
+            pass = pass && strcmp( frame2.function.data(), frame.function.data() ) == 0;
+            pass = pass && stack2.size() == stack.size() && stack2[0] == stack[0];
+            pass = pass && multi2.printString() == multi.printString();
+            pass = pass && err2.message == err.message && err2.type == err.type;
+            pass = pass && err2.signal == 11 && err2.stack == err.stack;
+            pass = pass && err2.source.line() == source.line();
+            pass = pass && strcmp( err2.source.file_name(), source.file_name() ) == 0;
+        } catch ( std::exception &e ) {
+            std::cout << e.what() << std::endl;
+            pass = false;
+        }
+        addMessage( results, pass, std::string( "structured output: " ) + name );
+    }
+}
+
+
+// Test printing the stack
+void testPrint( UnitTest &results )
+{
+    if ( getRank() != 0 )
+        return;
+    // Create a deep stack (deeper than the old fixed size prefix)
+    std::vector<StackTrace::stack_info> frames( 600 );
+    for ( size_t i = 0; i < frames.size(); i++ )
+        frames[i] = createFrame( 0x10 * ( i + 1 ), ( "fun" + std::to_string( i ) ).data() );
+    StackTrace::multi_stack_info stack;
+    stack.add( frames.size(), frames.data(), 2 );
+    stack.add( frames.size() / 2, frames.data() );
+    auto lines = stack.print( "  " );
+    auto str   = stack.printString( "  " );
+    std::string str2;
+    for ( const auto &line : lines )
+        str2 += line + "\n";
+    std::stringstream ss;
+    stack.print( ss, "  " );
+    std::string str3 = "header\n";
+    stack.appendString( str3, "  " );
+    std::string str4;
+    auto fid = tmpfile();
+    if ( fid ) {
+        stack.print( fileno( fid ), "  " );
+        rewind( fid );
+        char buf[4096];
+        for ( size_t N = fread( buf, 1, sizeof( buf ), fid ); N > 0;
+              N = fread( buf, 1, sizeof( buf ), fid ) )
+            str4.append( buf, N );
+        fclose( fid );
+    }
+    size_t width = 0;
+    for ( const auto &line : lines )
+        width = std::max( width, line.size() );
+    bool pass = lines.size() == 900 && width > 1200;
+    pass      = pass && str == str2 && str == ss.str() && str3 == "header\n" + str && str == str4;
+    addMessage( results, pass, "multi_stack_info::print" );
+}
+
+
 // Test finding the active threads
 void testActiveThreads( UnitTest &results )
 {
@@ -419,11 +1253,46 @@ void testStackFile( UnitTest &results, const std::string &filename )
     delete[] buf;
     // Load the stack
     auto stack = StackTrace::generateFromString( str );
+    std::vector<std::string> text;
+    std::stringstream ss( str );
+    for ( std::string line; std::getline( ss, line ); )
+        text.push_back( line );
+    auto t1     = time();
+    auto stack2 = StackTrace::generateFromFile( filename );
+    auto t2     = time();
+    auto stack3 = StackTrace::generateFromString( text );
+    printf( "Time to parse file: %0.3f ms\n", 1e3 * ( t2 - t1 ) );
+    bool pass = !stack.children.empty() && stack.printString() == stack2.printString();
+    pass      = pass && stack.printString() == stack3.printString();
+    addMessage( results, pass, "generateFromFile: " + filename );
     // Clean the stack trace
     cleanupStackTrace( stack );
     // Print the results
     stack.print( std::cout );
     std::cout << std::endl;
+    // Check the folded stacks and the flame graph
+    std::stringstream folded, svg;
+    stack.printFolded( folded );
+    stack.printFlameGraph( svg, filename );
+    std::string line;
+    int64_t N = 0, N2 = 0;
+    int lines = 0;
+    for ( const auto &child : stack.children )
+        N2 += child.N;
+    while ( std::getline( folded, line ) ) {
+        N += atoll( line.substr( line.rfind( ' ' ) + 1 ).data() );
+        lines++;
+    }
+    pass = lines > 0 && N == std::max( stack.N, N2 );
+    pass = pass && svg.str().find( "<svg" ) != std::string::npos;
+    pass = pass && svg.str().find( "</svg>" ) != std::string::npos;
+    addMessage( results, pass, "folded stack / flame graph: " + filename );
+    // Check the pprof output
+    std::stringstream pprof;
+    stack.writePprof( pprof );
+    auto data = pprof.str();
+    pass      = data.size() > 18 && data[0] == 0x1f && data[1] == static_cast<char>( 0x8b );
+    addMessage( results, pass, "pprof: " + filename );
 }
 
 
@@ -568,6 +1437,9 @@ int main( int argc, char *argv[] )
         // Test getting the stacktrace of another thread
         testThreadStack( results, decoded_symbols );
 
+        // Test limiting the depth of the stack
+        testStackDepth( results );
+
         // Test getting the full stacktrace of all thread
         testFullStack( results );
 
@@ -575,6 +1447,60 @@ int main( int argc, char *argv[] )
         testGlobalStack( results, false );
         testGlobalStack( results, true );
 
+        // Test getting the call stack of another process
+        testProcessStack( results );
+
+        // Test the sampling profiler
+        testProfiler( results );
+
+        // Test recording the profile to disk
+        testRecording( results );
+
+        // Test the heap profiler
+        testHeapProfiler( results );
+
+        // Test the hang watchdog
+        testWatchdog( results );
+
+        // Test the live stack dumps
+        testLiveDump( results );
+
+        // Test the mutex contention profiler
+        testMutexProfiler( results );
+
+        // Test the difference between two stacks
+        testDiff( results );
+
+        // Test the hot functions/paths
+        testHotspots( results );
+
+        // Test adding stacks to wide nodes
+        testMultiStackAdd( results );
+
+        // Test cleaning up a wide stack
+        testCleanup( results );
+
+        // Test aggregating stacks in bounded memory
+        testBoundedStack( results );
+
+        // Test the flat representation of the stack
+        testFlatStack( results );
+
+        // Test merging the stacks in parallel
+        testMergeStacks( results );
+
+        // Test resolving the frames shared by several threads
+        testGenerateStacks( results );
+
+        // Test packing/unpacking the stack
+        testPack( results );
+
+        // Test printing the stack
+        testPrint( results );
+
+        // Test the structured output
+        testStructured( results );
+
         // Test getting the symbols
         auto symbols = StackTrace::getSymbols();
         if ( !symbols.empty() )
@@ -120,7 +120,8 @@ void Utilities::abort( const std::string &message, const source_location &source
     err.type      = terminateType::abort;
     err.bytes     = Utilities::getMemoryUsage();
     err.stackType = StackTrace::getDefaultStackType();
-    err.stack     = StackTrace::backtrace();
+    err.stack     = StackTrace::backtrace(
+        thisThread(), StackTrace::getDefaultStackDepth(), StackTrace::getDefaultStackSkip() );
     throw err;
 }
 static std::mutex terminate_mutex;
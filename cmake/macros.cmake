@@ -98,7 +98,7 @@ MACRO( GET_SYSTEM_LIBS )
         MESSAGE("System libs: ${SYSTEM_LIBS}")
     ELSEIF( ${CMAKE_SYSTEM_NAME} STREQUAL "Linux" )
         # Linux specific system libraries
-        SET( SYSTEM_LIBS "-ldl -lpthread" )
+        SET( SYSTEM_LIBS "-ldl -lpthread -lrt" )
         IF ( NOT USE_STATIC )
             SET( SYSTEM_LIBS "${SYSTEM_LIBS} -rdynamic" )   # Needed for backtrace to print function names
         ENDIF()